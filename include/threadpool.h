@@ -100,7 +100,7 @@ class Result
 {
 public:
     Result(std::shared_ptr<Task> task, bool isValid = true);
-    ~Result() = default;
+    ~Result();
 
     // setVal方法。获取任务执行完的返回值
     void setVal(Any any);
@@ -130,6 +130,7 @@ public:
 
 private:
     Result *result_; // 不能用shared_ptr，会导致循环引用
+    std::mutex resultMtx_; // 保护result_，Result析构和任务执行完成可能同时发生
 };
 
 // 线程池支持的模式
@@ -160,7 +161,7 @@ public:
 
 private:
     ThreadFunc func_;
-    static int generatedId_; // 产生递增的线程ID，因为只有线程池线程访问，所以无需原子变量
+    static std::atomic_int generatedId_; // 产生递增的线程ID，进程内多个线程池、多个用户线程可能同时创建线程，需要原子变量
     int threadId_; // 保存线程id
 };
 
@@ -25,16 +25,23 @@ ThreadPool::~ThreadPool()
     // 优雅退出
     isPoolRunning_ = false;
 
-    // 等待线程池中所有线程返回，有两种状态，等待和执行
-    notEmpty_.notify_all();
+    // 等待线程池中所有线程返回，有两种状态，等待和执行；在锁下通知，避免等待方检查完状态还没开始等待时丢失唤醒
     std::unique_lock<std::mutex> lock(taskQueMtx_);
+    notEmpty_.notify_all();
     exitCond_.wait(lock, [&]() -> bool
                    { return threads_.size() == 0; });
 }
 
-// 开启线程池
+// 开启线程池，只能调用一次
 void ThreadPool::start(int initThreadSize)
 {
+    // 线程启动后就会访问线程列表，创建和启动都要在锁下进行
+    std::unique_lock<std::mutex> lock(taskQueMtx_);
+    if(isPoolRunning_)
+    {
+        return;
+    }
+
     // 设置线程池的启动状态
     isPoolRunning_ = true;
 
@@ -43,18 +50,20 @@ void ThreadPool::start(int initThreadSize)
     curThreadSize_ = initThreadSize;
 
     // 创建线程对象，保证公平性，先集中创建再启动
+    std::vector<int> threadIds;
     for (int i = 0; i < initThreadSize_; ++i)
     {
         // 创建thread线程对象的时候，把线程函数给到thread对象
         auto ptr = std::make_unique<Thread>(std::bind(&ThreadPool::threadFunc, this, std::placeholders::_1));
         int threadId = ptr->getId();
         threads_.emplace(threadId, std::move(ptr));
+        threadIds.push_back(threadId);
     }
 
-    // 启动所有线程
-    for (int i = 0; i < initThreadSize_; ++i)
+    // 启动所有线程，线程id是所有线程池共用的全局计数，不一定从0开始，需要用创建时拿到的id
+    for (int threadId : threadIds)
     {
-        threads_[i]->start();
+        threads_[threadId]->start();
         idleThreadSize_++;
     }
 }
@@ -268,12 +277,12 @@ bool ThreadPool::checkRunninngState() const
 }
 
 ///////////////// 线程方法实现
-int Thread::generatedId_ = 0;
+std::atomic_int Thread::generatedId_(0);
 
 // 线程构造函数
 Thread::Thread(ThreadFunc func)
     :func_(func)
-    , threadId_(generatedId_++)
+    , threadId_(generatedId_.fetch_add(1))
 {}
 
 // 线程析构
@@ -303,14 +312,19 @@ Task::Task()
 
 void Task::exec()
 {
+    Any any = run();
+
+    // 用户可能没有保存submitTask返回的Result，Result析构时会把result_置空，需要在锁下判断
+    std::unique_lock<std::mutex> lock(resultMtx_);
     if(result_ != nullptr)
     {
-        result_->setVal(run());
+        result_->setVal(std::move(any));
     }
 }
 
 void Task::setResult(Result* res)
 {
+    std::unique_lock<std::mutex> lock(resultMtx_);
     result_ = res;
 }
 
@@ -323,6 +337,12 @@ Result::Result(std::shared_ptr<Task> task, bool isValid)
     task_->setResult(this);
 }
 
+// Result析构时和任务断开，避免任务执行完后访问已经析构的Result
+Result::~Result()
+{
+    task_->setResult(nullptr);
+}
+
 Any Result::get()
 {
     if(!isValid_)
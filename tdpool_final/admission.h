@@ -0,0 +1,237 @@
+#ifndef ADMISSION_H
+#define ADMISSION_H
+
+#include"threadpool.h"
+
+#include<cmath>
+#include<chrono>
+
+/*
+example:
+ThreadPool pool;
+pool.start(8);
+
+auto rate = std::make_shared<TokenBucketPolicy>(1000, 100); // 每个标签默认每秒1000个任务，突发100个
+rate->setLimit("tenant-a", 5000, 500);
+pool.addAdmissionPolicy(rate);
+pool.addAdmissionPolicy(std::make_shared<CoDelPolicy>());
+pool.addAdmissionPolicy(std::make_shared<AimdConcurrencyPolicy>(64, 8, 1024, std::chrono::milliseconds(50)));
+
+auto res = pool.trySubmitTask("tenant-a", handle, req);
+if(res.status != SubmitStatus::OK) { // 立即拒绝 }
+*/
+// 常用的准入策略：令牌桶限速、基于排队时间的CoDel拒绝、AIMD自适应并发上限
+
+// 令牌桶限速：每个标签一个桶，按rate每秒补充令牌，最多积攒burst个，每个任务消耗一个令牌
+class TokenBucketPolicy : public AdmissionPolicy
+{
+public:
+    // rate、burst为没有单独设置的标签（包括nullptr）使用的默认值
+    TokenBucketPolicy(double rate, double burst)
+        : defaultRate_(rate)
+        , defaultBurst_(burst)
+    {}
+
+    // 单独设置某个标签的速率
+    void setLimit(const std::string &tag, double rate, double burst)
+    {
+        std::unique_lock<std::mutex> lock(mtx_);
+        Bucket &bucket = buckets_[tag];
+        bucket.rate = rate;
+        bucket.burst = burst;
+        bucket.tokens = std::min(bucket.tokens, burst);
+    }
+
+    bool admit(const char *tag) override
+    {
+        auto now = std::chrono::steady_clock::now();
+        std::unique_lock<std::mutex> lock(mtx_);
+        auto it = buckets_.find(tag == nullptr ? std::string() : std::string(tag));
+        if(it == buckets_.end())
+        {
+            Bucket bucket;
+            bucket.rate = defaultRate_;
+            bucket.burst = defaultBurst_;
+            bucket.tokens = defaultBurst_;
+            bucket.last = now;
+            it = buckets_.emplace(tag == nullptr ? std::string() : std::string(tag), bucket).first;
+        }
+
+        Bucket &bucket = it->second;
+        if(bucket.last == std::chrono::steady_clock::time_point())
+        {
+            // setLimit创建的桶第一次使用，从满桶开始
+            bucket.tokens = bucket.burst;
+            bucket.last = now;
+        }
+        double elapsed = std::chrono::duration<double>(now - bucket.last).count();
+        bucket.tokens = std::min(bucket.burst, bucket.tokens + elapsed * bucket.rate);
+        bucket.last = now;
+        if(bucket.tokens < 1.0)
+        {
+            return false;
+        }
+        bucket.tokens -= 1.0;
+        return true;
+    }
+
+    // 被后面的策略拒绝时退还令牌
+    void onCancel(const char *tag) override
+    {
+        std::unique_lock<std::mutex> lock(mtx_);
+        auto it = buckets_.find(tag == nullptr ? std::string() : std::string(tag));
+        if(it != buckets_.end())
+        {
+            it->second.tokens = std::min(it->second.burst, it->second.tokens + 1.0);
+        }
+    }
+
+private:
+    struct Bucket
+    {
+        double rate = 0;
+        double burst = 0;
+        double tokens = 0;
+        std::chrono::steady_clock::time_point last; // 上次补充令牌的时间
+    };
+
+    std::mutex mtx_;
+    std::unordered_map<std::string, Bucket> buckets_;
+    double defaultRate_;
+    double defaultBurst_;
+};
+
+// CoDel风格的拒绝：排队时间持续一个interval都高于target时进入拒绝状态，
+// 按CoDel的控制律拒绝提交，第count次拒绝之后间隔interval / sqrt(count)再拒绝下一个；排队时间回到target以下时退出
+// 排队时间在任务出队时测量，所以只有队列在流动时才会更新状态
+class CoDelPolicy : public AdmissionPolicy
+{
+public:
+    CoDelPolicy(std::chrono::nanoseconds target = std::chrono::milliseconds(5),
+                std::chrono::nanoseconds interval = std::chrono::milliseconds(100))
+        : target_(target)
+        , interval_(interval)
+        , dropping_(false)
+        , count_(0)
+    {}
+
+    bool admit(const char *) override
+    {
+        std::unique_lock<std::mutex> lock(mtx_);
+        if(!dropping_)
+        {
+            return true;
+        }
+        auto now = std::chrono::steady_clock::now();
+        if(now < dropNext_)
+        {
+            return true;
+        }
+        count_++;
+        dropNext_ = now + std::chrono::duration_cast<std::chrono::nanoseconds>(interval_ / std::sqrt((double)count_));
+        return false;
+    }
+
+    void onStart(const char *, std::chrono::nanoseconds sojourn) override
+    {
+        auto now = std::chrono::steady_clock::now();
+        std::unique_lock<std::mutex> lock(mtx_);
+        if(sojourn < target_)
+        {
+            // 排队时间恢复正常，退出拒绝状态
+            firstAboveTime_ = std::chrono::steady_clock::time_point();
+            dropping_ = false;
+            count_ = 0;
+        }
+        else if(firstAboveTime_ == std::chrono::steady_clock::time_point())
+        {
+            firstAboveTime_ = now + interval_;
+        }
+        else if(!dropping_ && now >= firstAboveTime_)
+        {
+            dropping_ = true;
+            dropNext_ = now;
+        }
+    }
+
+    // 当前是否处于拒绝状态
+    bool overloaded()
+    {
+        std::unique_lock<std::mutex> lock(mtx_);
+        return dropping_;
+    }
+
+private:
+    std::mutex mtx_;
+    std::chrono::nanoseconds target_; // 可以接受的排队时间
+    std::chrono::nanoseconds interval_; // 排队时间持续超标多久才开始拒绝
+    std::chrono::steady_clock::time_point firstAboveTime_; // 排队时间超标满一个interval的时刻
+    std::chrono::steady_clock::time_point dropNext_; // 下一次拒绝的时刻
+    bool dropping_;
+    uint64_t count_; // 本轮拒绝状态中已经拒绝的次数
+};
+
+// AIMD自适应并发上限：限制已提交还没执行完的任务数量
+// 任务延迟不超过target时上限加性增长（每个上限周期加1），超过时乘性减少
+class AimdConcurrencyPolicy : public AdmissionPolicy
+{
+public:
+    AimdConcurrencyPolicy(double initialLimit, double minLimit, double maxLimit,
+                          std::chrono::nanoseconds target, double backoff = 0.9)
+        : limit_(initialLimit)
+        , minLimit_(minLimit)
+        , maxLimit_(maxLimit)
+        , target_(target)
+        , backoff_(backoff)
+        , inflight_(0)
+    {}
+
+    bool admit(const char *) override
+    {
+        std::unique_lock<std::mutex> lock(mtx_);
+        if(inflight_ >= (size_t)limit_)
+        {
+            return false;
+        }
+        inflight_++;
+        return true;
+    }
+
+    void onCancel(const char *) override
+    {
+        std::unique_lock<std::mutex> lock(mtx_);
+        inflight_--;
+    }
+
+    void onComplete(const char *, std::chrono::nanoseconds latency) override
+    {
+        std::unique_lock<std::mutex> lock(mtx_);
+        inflight_--;
+        if(latency > target_)
+        {
+            limit_ = std::max(minLimit_, limit_ * backoff_);
+        }
+        else
+        {
+            limit_ = std::min(maxLimit_, limit_ + 1.0 / limit_);
+        }
+    }
+
+    // 当前的并发上限
+    double limit()
+    {
+        std::unique_lock<std::mutex> lock(mtx_);
+        return limit_;
+    }
+
+private:
+    std::mutex mtx_;
+    double limit_;
+    double minLimit_;
+    double maxLimit_;
+    std::chrono::nanoseconds target_; // 延迟目标
+    double backoff_; // 超过延迟目标时的乘性减少系数
+    size_t inflight_; // 已准入还没执行完的任务数量
+};
+
+#endif
\ No newline at end of file
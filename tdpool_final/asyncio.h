@@ -0,0 +1,472 @@
+#ifndef ASYNCIO_H
+#define ASYNCIO_H
+
+#include"threadpool.h"
+
+#include<sys/types.h>
+#include<sys/uio.h>
+#include<unistd.h>
+#include<cerrno>
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#include<linux/io_uring.h>
+#include<sys/mman.h>
+#include<sys/syscall.h>
+#define ASYNCIO_HAS_IO_URING 1
+#endif
+
+// 提交线程写好的Op经过内核的环形队列交给收割线程，ThreadSanitizer看不到这条同步关系，需要手动标注
+#if defined(__SANITIZE_THREAD__)
+#define ASYNCIO_TSAN 1
+#elif defined(__has_feature)
+#if __has_feature(thread_sanitizer)
+#define ASYNCIO_TSAN 1
+#endif
+#endif
+#ifdef ASYNCIO_TSAN
+extern "C" void __tsan_acquire(void *addr);
+extern "C" void __tsan_release(void *addr);
+#endif
+
+/*
+example:
+ThreadPool pool;
+pool.start(4);
+AsyncIO io(pool);
+
+char buf[4096];
+std::future<ssize_t> n = io.readAsync(fd, buf, sizeof(buf), 0);
+io.writeAsync(fd, buf, sizeof(buf), 0, [](ssize_t res) { // 在线程池中执行的后续处理... });
+io.fsyncAsync(fd).get();
+*/
+// 线程池的异步文件IO
+// 有io_uring时，提交合并进同一个提交队列，由专门的收割线程取完成事件，再把后续处理提交到线程池，线程池拒绝时在收割线程中执行；
+// 内核不支持io_uring时，退化为线程池中的阻塞IO资源组，在阻塞区域中执行pread/pwrite/fsync
+// 结果与io_uring一致：成功返回字节数（fsync为0），失败返回-errno；退化模式下线程池拒绝IO任务时返回-EAGAIN，回调在提交线程中执行
+class AsyncIO
+{
+public:
+    // IO完成后在线程池中执行的后续处理，参数为IO的结果
+    using Callback = std::function<void(ssize_t)>;
+
+    // entries为io_uring提交队列的长度，blockingThreads为退化模式下阻塞IO资源组的并发上限
+    AsyncIO(ThreadPool &pool, unsigned entries = 256, size_t blockingThreads = 16)
+        : pool_(pool)
+        , ringFd_(-1)
+        , inflight_(0)
+        , pending_(0)
+        , flushing_(false)
+        , stopping_(false)
+    {
+#ifdef ASYNCIO_HAS_IO_URING
+        if(setupRing(entries))
+        {
+            reaper_ = std::thread(&AsyncIO::reapFunc, this);
+            return;
+        }
+        std::cerr << "io_uring is unavailable, fall back to blocking io." << std::endl;
+#endif
+        blockingGroup_ = pool_.createGroup("blocking-io", 1, blockingThreads);
+    }
+
+    // 析构时等待所有已提交的IO完成；io_uring模式下提交到线程池的后续处理可能还没有执行
+    ~AsyncIO()
+    {
+#ifdef ASYNCIO_HAS_IO_URING
+        if(ringFd_ >= 0)
+        {
+            // 提交一个user_data为0的空操作通知收割线程退出
+            {
+                std::unique_lock<std::mutex> lock(sqMtx_);
+                io_uring_sqe *sqe = getSqe(lock);
+                sqe->opcode = IORING_OP_NOP;
+                sqe->user_data = 0;
+                commitSqe(lock);
+            }
+            flush();
+            reaper_.join();
+            destroyRing();
+        }
+#endif
+        if(blockingGroup_ != nullptr)
+        {
+            {
+                std::unique_lock<std::mutex> lock(sqMtx_);
+                drained_.wait(lock, [&]() -> bool { return inflight_ == 0; });
+            }
+            // 资源组不再接受新的IO，已经排队的执行完后从线程池的调度中删除
+            pool_.removeGroup(blockingGroup_);
+        }
+    }
+
+    AsyncIO(const AsyncIO &) = delete;
+    AsyncIO &operator=(const AsyncIO &) = delete;
+
+    // 从fd的offset处读取len字节到buf中，buf在IO完成前必须有效
+    std::future<ssize_t> readAsync(int fd, void *buf, size_t len, off_t offset, Callback callback = nullptr)
+    {
+#ifdef ASYNCIO_HAS_IO_URING
+        if(ringFd_ >= 0)
+        {
+            return submitRw(IORING_OP_READV, fd, buf, len, offset, std::move(callback));
+        }
+#endif
+        return submitBlocking([=]() -> ssize_t
+        {
+            ssize_t res = ::pread(fd, buf, len, offset);
+            return res < 0 ? -errno : res;
+        }, std::move(callback));
+    }
+
+    // 把buf中的len字节写到fd的offset处，buf在IO完成前必须有效
+    std::future<ssize_t> writeAsync(int fd, const void *buf, size_t len, off_t offset, Callback callback = nullptr)
+    {
+#ifdef ASYNCIO_HAS_IO_URING
+        if(ringFd_ >= 0)
+        {
+            return submitRw(IORING_OP_WRITEV, fd, const_cast<void *>(buf), len, offset, std::move(callback));
+        }
+#endif
+        return submitBlocking([=]() -> ssize_t
+        {
+            ssize_t res = ::pwrite(fd, buf, len, offset);
+            return res < 0 ? -errno : res;
+        }, std::move(callback));
+    }
+
+    // 把fd的数据刷到磁盘
+    std::future<ssize_t> fsyncAsync(int fd, Callback callback = nullptr)
+    {
+#ifdef ASYNCIO_HAS_IO_URING
+        if(ringFd_ >= 0)
+        {
+            Op *op = new Op(std::move(callback));
+            std::future<ssize_t> result = op->promise.get_future();
+            {
+                std::unique_lock<std::mutex> lock(sqMtx_);
+                io_uring_sqe *sqe = getSqe(lock);
+                sqe->opcode = IORING_OP_FSYNC;
+                sqe->fd = fd;
+                sqe->user_data = reinterpret_cast<uint64_t>(op);
+                commitSqe(lock);
+            }
+            flush();
+            return result;
+        }
+#endif
+        return submitBlocking([=]() -> ssize_t
+        {
+            return ::fsync(fd) < 0 ? -errno : 0;
+        }, std::move(callback));
+    }
+
+    // 当前是否使用io_uring，false表示退化为阻塞IO资源组
+    bool usingIoUring() const
+    {
+        return ringFd_ >= 0;
+    }
+
+private:
+    // 退化模式：在阻塞IO资源组中执行，阻塞区域让线程池补偿CPU线程
+    // 线程池拒绝（准入策略、队列满）时不能返回线程池的空返回值，0会被当成读到文件末尾或者写入0字节，按-EAGAIN完成
+    template<typename Func>
+    std::future<ssize_t> submitBlocking(Func func, Callback callback)
+    {
+        {
+            std::unique_lock<std::mutex> lock(sqMtx_);
+            inflight_++;
+        }
+        // 任务执行完或者被资源组拒绝时，guard随任务对象一起销毁
+        auto guard = std::make_shared<BlockingGuard>(this);
+        auto submitted = blockingGroup_->trySubmitTask(nullptr, [func, callback, guard]() -> ssize_t
+        {
+            ssize_t res = ThreadPool::managedBlock(func);
+            if(callback)
+            {
+                callback(res);
+            }
+            return res;
+        });
+        if(submitted.status == SubmitStatus::OK)
+        {
+            return std::move(submitted.future);
+        }
+
+        std::promise<ssize_t> rejected;
+        rejected.set_value(-EAGAIN);
+        if(callback)
+        {
+            callback(-EAGAIN);
+        }
+        return rejected.get_future();
+    }
+
+    // 退化模式下IO任务的生命周期标记，销毁时进行中的IO数量减一
+    struct BlockingGuard
+    {
+        explicit BlockingGuard(AsyncIO *io)
+            : io(io)
+        {}
+
+        ~BlockingGuard()
+        {
+            io->finishBlocking();
+        }
+
+        AsyncIO *io;
+    };
+
+    // 退化模式下一个IO执行完成，最后一个完成时唤醒等待的析构函数
+    void finishBlocking()
+    {
+        std::unique_lock<std::mutex> lock(sqMtx_);
+        if(--inflight_ == 0)
+        {
+            drained_.notify_all();
+        }
+    }
+
+#ifdef ASYNCIO_HAS_IO_URING
+    // 一个进行中的IO操作，地址作为sqe的user_data，收割线程通过它找到对应的promise
+    struct Op
+    {
+        explicit Op(Callback cb)
+            : callback(std::move(cb))
+        {}
+
+        std::promise<ssize_t> promise;
+        Callback callback;
+        iovec iov; // readv/writev的参数，需要在IO完成前保持有效
+    };
+
+    std::future<ssize_t> submitRw(uint8_t opcode, int fd, void *buf, size_t len, off_t offset, Callback callback)
+    {
+        Op *op = new Op(std::move(callback));
+        op->iov.iov_base = buf;
+        op->iov.iov_len = len;
+        std::future<ssize_t> result = op->promise.get_future();
+        {
+            std::unique_lock<std::mutex> lock(sqMtx_);
+            io_uring_sqe *sqe = getSqe(lock);
+            sqe->opcode = opcode;
+            sqe->fd = fd;
+            sqe->addr = reinterpret_cast<uint64_t>(&op->iov);
+            sqe->len = 1;
+            sqe->off = offset;
+            sqe->user_data = reinterpret_cast<uint64_t>(op);
+            commitSqe(lock);
+        }
+        flush();
+        return result;
+    }
+
+    bool setupRing(unsigned entries)
+    {
+        io_uring_params params{};
+        int fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+        if(fd < 0)
+        {
+            return false;
+        }
+
+        sqRingSize_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cqRingSize_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool singleMmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if(singleMmap)
+        {
+            sqRingSize_ = cqRingSize_ = std::max(sqRingSize_, cqRingSize_);
+        }
+
+        sqRing_ = mmap(nullptr, sqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+        if(sqRing_ == MAP_FAILED)
+        {
+            ::close(fd);
+            return false;
+        }
+        cqRing_ = singleMmap ? sqRing_
+                             : mmap(nullptr, cqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        sqes_ = static_cast<io_uring_sqe *>(mmap(nullptr, params.sq_entries * sizeof(io_uring_sqe),
+                                                 PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES));
+        if(cqRing_ == MAP_FAILED || sqes_ == MAP_FAILED)
+        {
+            if(sqes_ != MAP_FAILED)
+            {
+                munmap(sqes_, params.sq_entries * sizeof(io_uring_sqe));
+            }
+            if(cqRing_ != MAP_FAILED && cqRing_ != sqRing_)
+            {
+                munmap(cqRing_, cqRingSize_);
+            }
+            munmap(sqRing_, sqRingSize_);
+            ::close(fd);
+            return false;
+        }
+
+        char *sq = static_cast<char *>(sqRing_);
+        char *cq = static_cast<char *>(cqRing_);
+        sqHead_ = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+        sqTail_ = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+        sqMask_ = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+        sqArray_ = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+        cqHead_ = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+        cqTail_ = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+        cqMask_ = *reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+        cqes_ = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+        sqEntries_ = params.sq_entries;
+        cqEntries_ = params.cq_entries;
+        ringFd_ = fd;
+        return true;
+    }
+
+    void destroyRing()
+    {
+        munmap(sqes_, sqEntries_ * sizeof(io_uring_sqe));
+        if(cqRing_ != sqRing_)
+        {
+            munmap(cqRing_, cqRingSize_);
+        }
+        munmap(sqRing_, sqRingSize_);
+        ::close(ringFd_);
+    }
+
+    // 获取一个空闲的sqe，提交队列满或者进行中的IO超过完成队列长度时等待，调用方需要持有sqMtx_
+    io_uring_sqe *getSqe(std::unique_lock<std::mutex> &lock)
+    {
+        sqNotFull_.wait(lock, [&]() -> bool
+        {
+            unsigned head = __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE);
+            return *sqTail_ - head < sqEntries_ && inflight_ < cqEntries_;
+        });
+        io_uring_sqe *sqe = &sqes_[*sqTail_ & sqMask_];
+        *sqe = io_uring_sqe{};
+        return sqe;
+    }
+
+    // 发布getSqe取到的sqe，此时还没有通知内核，由flush合并提交，调用方需要持有sqMtx_
+    void commitSqe(std::unique_lock<std::mutex> &)
+    {
+        unsigned tail = *sqTail_;
+#ifdef ASYNCIO_TSAN
+        __tsan_release(reinterpret_cast<void *>(sqes_[tail & sqMask_].user_data));
+#endif
+        sqArray_[tail & sqMask_] = tail & sqMask_;
+        __atomic_store_n(sqTail_, tail + 1, __ATOMIC_RELEASE);
+        inflight_++;
+        pending_++;
+    }
+
+    // 通知内核提交所有已发布的sqe
+    // 同一时刻只有一个线程调用io_uring_enter，其他线程发布的sqe由它一起提交，实现批量提交
+    void flush()
+    {
+        std::unique_lock<std::mutex> lock(sqMtx_);
+        if(flushing_)
+        {
+            return;
+        }
+        flushing_ = true;
+        while(pending_ > 0)
+        {
+            unsigned toSubmit = pending_;
+            pending_ = 0;
+            lock.unlock();
+            int ret = (int)syscall(__NR_io_uring_enter, ringFd_, toSubmit, 0, 0, nullptr, 0);
+            lock.lock();
+            if(ret < 0)
+            {
+                // EINTR、EAGAIN、EBUSY都是暂时的，稍后重试
+                pending_ += toSubmit;
+                lock.unlock();
+                std::this_thread::yield();
+                lock.lock();
+            }
+            else if((unsigned)ret < toSubmit)
+            {
+                pending_ += toSubmit - ret;
+            }
+        }
+        flushing_ = false;
+    }
+
+    // 收割线程：等待完成事件，设置结果，把后续处理提交到线程池
+    void reapFunc()
+    {
+        for(;;)
+        {
+            syscall(__NR_io_uring_enter, ringFd_, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+
+            unsigned head = *cqHead_;
+            unsigned tail = __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE);
+            unsigned reaped = 0;
+            for(; head != tail; ++head, ++reaped)
+            {
+                const io_uring_cqe &cqe = cqes_[head & cqMask_];
+                Op *op = reinterpret_cast<Op *>(cqe.user_data);
+                if(op == nullptr)
+                {
+                    stopping_ = true;
+                    continue;
+                }
+#ifdef ASYNCIO_TSAN
+                __tsan_acquire(op);
+#endif
+                op->promise.set_value(cqe.res);
+                if(op->callback)
+                {
+                    // 收割线程不能阻塞在线程池的提交上，线程池队列满或者拒绝时直接在这里执行
+                    auto submitted = pool_.trySubmitTask(nullptr, op->callback, (ssize_t)cqe.res);
+                    if(submitted.status != SubmitStatus::OK)
+                    {
+                        op->callback(cqe.res);
+                    }
+                }
+                delete op;
+            }
+            __atomic_store_n(cqHead_, head, __ATOMIC_RELEASE);
+
+            std::unique_lock<std::mutex> lock(sqMtx_);
+            inflight_ -= reaped;
+            sqNotFull_.notify_all();
+            if(stopping_ && inflight_ == 0)
+            {
+                return;
+            }
+        }
+    }
+
+#endif
+
+private:
+    ThreadPool &pool_;
+    std::shared_ptr<ThreadPool::TaskGroup> blockingGroup_; // 退化模式下执行阻塞IO的资源组
+    int ringFd_; // io_uring的文件描述符，-1表示退化模式
+
+    std::mutex sqMtx_; // 保护提交队列
+    std::condition_variable sqNotFull_; // 提交队列有空位
+    std::condition_variable drained_; // 退化模式下进行中的IO全部完成
+    unsigned inflight_; // 进行中的IO数量：io_uring模式下是已发布还没有收割的sqe，不能超过完成队列长度；退化模式下是还没执行完的阻塞IO
+    unsigned pending_; // 已发布还没有通知内核的sqe数量
+    bool flushing_; // 是否有线程正在调用io_uring_enter
+    bool stopping_; // 收割线程收到了退出通知
+
+#ifdef ASYNCIO_HAS_IO_URING
+    void *sqRing_;
+    void *cqRing_;
+    size_t sqRingSize_;
+    size_t cqRingSize_;
+    unsigned *sqHead_;
+    unsigned *sqTail_;
+    unsigned *sqArray_;
+    unsigned sqMask_;
+    unsigned sqEntries_;
+    io_uring_sqe *sqes_;
+    unsigned *cqHead_;
+    unsigned *cqTail_;
+    unsigned cqMask_;
+    unsigned cqEntries_;
+    io_uring_cqe *cqes_;
+    std::thread reaper_; // 专门的收割线程
+#endif
+};
+
+#endif
\ No newline at end of file
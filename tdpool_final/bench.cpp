@@ -0,0 +1,174 @@
+#include<iostream>
+#include<vector>
+#include<random>
+#include<chrono>
+#include<algorithm>
+#include<numeric>
+#include<unordered_map>
+#include<mutex>
+#include"parallel.h"
+
+// make bench BENCH_ARGS=[元素个数]，或者 g++ -O2 -std=c++17 bench.cpp -o bench -pthread && ./bench [元素个数]
+// 结果与std::不一致时打印[MISMATCH]并返回非0
+
+// 执行func并返回耗时（毫秒）
+template<typename Func>
+double timeIt(Func&& func)
+{
+    auto begin = std::chrono::steady_clock::now();
+    func();
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(end - begin).count();
+}
+
+static bool mismatch = false;
+
+void report(const char *name, double serial, double parallel, bool ok)
+{
+    mismatch = mismatch || !ok;
+    std::cout << name << ": serial " << serial << " ms, pool " << parallel << " ms, speedup "
+              << serial / parallel << (ok ? "" : "  [MISMATCH]") << std::endl;
+}
+
+int main(int argc, char **argv)
+{
+    size_t n = argc > 1 ? std::stoul(argv[1]) : (1 << 24);
+
+    ThreadPool pool;
+    pool.setTaskQueMaxThreshHold(1024);
+    pool.start();
+
+    std::mt19937 rng(42);
+    std::vector<int> input(n);
+    for(auto &x : input)
+    {
+        x = (int)(rng() % 1000000);
+    }
+
+    {
+        std::vector<int> a = input, b = input;
+        double serial = timeIt([&]() { std::sort(a.begin(), a.end()); });
+        double parallel = timeIt([&]() { parallelSort(pool, b.begin(), b.end()); });
+        report("sort", serial, parallel, a == b);
+    }
+
+    {
+        std::vector<long long> a(n), b(n);
+        double serial = timeIt([&]() { std::inclusive_scan(input.begin(), input.end(), a.begin(), std::plus<long long>(), 0LL); });
+        std::vector<long long> wide(input.begin(), input.end());
+        double parallel = timeIt([&]() { parallelInclusiveScan(pool, wide.begin(), wide.end(), b.begin()); });
+        report("inclusive_scan", serial, parallel, a == b);
+    }
+
+    {
+        std::vector<long long> a(n), b(n);
+        std::vector<long long> wide(input.begin(), input.end());
+        double serial = timeIt([&]() { std::exclusive_scan(wide.begin(), wide.end(), a.begin(), 0LL); });
+        double parallel = timeIt([&]() { parallelExclusiveScan(pool, wide.begin(), wide.end(), b.begin(), 0LL); });
+        report("exclusive_scan", serial, parallel, a == b);
+    }
+
+    {
+        auto square = [](int x) -> long long { return (long long)x * x; };
+        long long a = 0, b = 0;
+        double serial = timeIt([&]() { a = std::transform_reduce(input.begin(), input.end(), 0LL, std::plus<>(), square); });
+        double parallel = timeIt([&]() { b = parallelTransformReduce(pool, input.begin(), input.end(), 0LL, std::plus<>(), square); });
+        report("transform_reduce", serial, parallel, a == b);
+    }
+
+    {
+        std::vector<float> a(n), b(n);
+        auto scale = [](int x) -> float { return x * 0.5f + 1.0f; };
+        double serial = timeIt([&]() { std::transform(input.begin(), input.end(), a.begin(), scale); });
+        double parallel = timeIt([&]() { parallelTransform(pool, input.begin(), input.end(), b.begin(), scale); });
+        report("transform", serial, parallel, a == b);
+    }
+
+    {
+        // 目标在区间的3/4处，测提前结束的效果
+        std::vector<int> v = input;
+        v[n / 4 * 3] = -1;
+        auto isTarget = [](int x) { return x < 0; };
+        std::vector<int>::iterator a, b;
+        double serial = timeIt([&]() { a = std::find_if(v.begin(), v.end(), isTarget); });
+        double parallel = timeIt([&]() { b = parallelFindIf(pool, v.begin(), v.end(), isTarget); });
+        report("find_if", serial, parallel, a == b);
+    }
+
+    {
+        std::vector<int> a = input, b = input;
+        auto isEven = [](int x) { return x % 2 == 0; };
+        double serial = timeIt([&]() { std::stable_partition(a.begin(), a.end(), isEven); });
+        double parallel = timeIt([&]() { parallelStablePartition(pool, b.begin(), b.end(), isEven); });
+        report("stable_partition", serial, parallel, a == b);
+    }
+
+    {
+        // 分区哈希聚合：输入按键分区，每个分区一张哈希表，按批次提交，同一个分区的批次在不同线程上执行时哈希表需要在核间迁移
+        // 对比共享队列（批次散落到任意线程）和按分区号提交亲和性提示（同一个分区的批次留在同一个线程上）
+        const size_t partitions = std::max(1u, std::thread::hardware_concurrency()) * 2;
+        const size_t batch = 4096;
+        std::vector<std::vector<int>> parts(partitions);
+        for(int x : input)
+        {
+            parts[std::hash<int>()(x) % partitions].push_back(x);
+        }
+
+        auto aggregate = [&](bool affinity) -> long long
+        {
+            std::vector<std::unordered_map<int, long long>> tables(partitions);
+            std::vector<std::mutex> locks(partitions); // 共享队列下同一个分区的批次可能并发执行
+            std::vector<std::future<void>> results;
+            size_t rounds = 0;
+            for(auto &part : parts)
+            {
+                rounds = std::max(rounds, (part.size() + batch - 1) / batch);
+            }
+            // 按轮次交错提交各个分区的批次，模拟数据流
+            for(size_t r = 0; r < rounds; ++r)
+            {
+                for(size_t p = 0; p < partitions; ++p)
+                {
+                    size_t begin = r * batch;
+                    if(begin >= parts[p].size())
+                    {
+                        continue;
+                    }
+                    size_t end = std::min(begin + batch, parts[p].size());
+                    auto task = [&, p, begin, end]()
+                    {
+                        std::unique_lock<std::mutex> lock(locks[p]);
+                        auto &table = tables[p];
+                        for(size_t i = begin; i < end; ++i)
+                        {
+                            table[parts[p][i]] += parts[p][i];
+                        }
+                    };
+                    results.emplace_back(affinity ? pool.submitTask(Affinity::key(p), task) : pool.submitTask(task));
+                }
+            }
+            for(auto &result : results)
+            {
+                result.get();
+            }
+            long long total = 0;
+            for(auto &table : tables)
+            {
+                for(auto &entry : table)
+                {
+                    total += entry.second;
+                }
+            }
+            return total;
+        };
+
+        long long a = 0, b = 0;
+        double shared = timeIt([&]() { a = aggregate(false); });
+        double affine = timeIt([&]() { b = aggregate(true); });
+        std::cout << "hash_aggregate: shared queue " << shared << " ms, affinity " << affine << " ms, speedup "
+                  << shared / affine << (a == b ? "" : "  [MISMATCH]") << std::endl;
+        mismatch = mismatch || a != b;
+    }
+
+    return mismatch ? 1 : 0;
+}
\ No newline at end of file
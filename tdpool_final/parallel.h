@@ -0,0 +1,435 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include"threadpool.h"
+
+#include<iterator>
+#include<numeric>
+#include<algorithm>
+#include<exception>
+
+/*
+example:
+ThreadPool pool;
+pool.setTaskQueMaxThreshHold(1024);
+pool.start(8);
+
+std::vector<int> v = ...;
+parallelSort(pool, v.begin(), v.end());
+parallelInclusiveScan(pool, v.begin(), v.end(), v.begin());
+long long sum = parallelTransformReduce(pool, v.begin(), v.end(), 0LL, std::plus<>(), [](int x) { return (long long)x * x; });
+auto it = parallelFindIf(pool, v.begin(), v.end(), [](int x) { return x > 100; });
+*/
+// 基于线程池的并行算法，复用线程池的工作线程，不另外创建线程
+// 区间被切成若干块，调用线程和提交到线程池的辅助任务一起通过原子计数器领取块来执行，
+// 所以即使线程池很忙或者任务提交失败，调用线程也会把剩下的块做完，在工作线程里调用也不会死锁
+// 块内部是简单的顺序循环（std::sort、std::transform等），便于编译器向量化
+
+const size_t PARALLEL_MIN_CHUNK = 4096; // 每块的最少元素个数，太小的块调度开销大于收益
+const size_t PARALLEL_CHUNKS_PER_THREAD = 4; // 每个线程平均分到的块数，用来平衡负载
+
+// 根据元素个数和线程数计算块数
+inline size_t parallelChunkCount(ThreadPool &pool, size_t n)
+{
+    size_t threads = std::max<size_t>(1, pool.getThreadSize());
+    size_t chunks = std::min(n / PARALLEL_MIN_CHUNK, threads * PARALLEL_CHUNKS_PER_THREAD);
+    return std::max<size_t>(1, chunks);
+}
+
+// 第chunk块在n个元素中的起始下标
+inline size_t parallelChunkBegin(size_t n, size_t chunks, size_t chunk)
+{
+    return n / chunks * chunk + std::min(chunk, n % chunks);
+}
+
+// 并行执行func(0) ... func(chunks - 1)，全部完成后返回，任意一块抛出的第一个异常会在调用线程重新抛出
+template<typename Func>
+void parallelChunks(ThreadPool &pool, size_t chunks, Func&& func)
+{
+    if(chunks == 0)
+    {
+        return;
+    }
+    if(chunks == 1)
+    {
+        func(0);
+        return;
+    }
+
+    // 辅助任务可能在调用返回后才开始执行，共享状态用shared_ptr保活；此时所有块都已领取完，不会再访问func
+    struct State
+    {
+        std::atomic<size_t> next{0};
+        std::atomic<size_t> done{0};
+        size_t chunks = 0;
+        std::function<void(size_t)> func;
+        std::exception_ptr error;
+        std::mutex mtx;
+        std::condition_variable cond;
+
+        void run()
+        {
+            size_t chunk;
+            while((chunk = next++) < chunks)
+            {
+                try
+                {
+                    func(chunk);
+                }
+                catch(...)
+                {
+                    std::unique_lock<std::mutex> lock(mtx);
+                    if(!error)
+                    {
+                        error = std::current_exception();
+                    }
+                }
+                if(++done == chunks)
+                {
+                    std::unique_lock<std::mutex> lock(mtx);
+                    cond.notify_all();
+                }
+            }
+        }
+    };
+
+    auto state = std::make_shared<State>();
+    state->chunks = chunks;
+    state->func = std::ref(func);
+
+    size_t helpers = std::min(chunks - 1, std::max<size_t>(1, pool.getThreadSize()));
+    for(size_t i = 0; i < helpers; ++i)
+    {
+        // 不等待队列空位：队列满或者被拒绝时剩下的块由当前线程和已经提交的帮手完成
+        if(pool.trySubmitTask(nullptr, [state]() { state->run(); }).status != SubmitStatus::OK)
+        {
+            break;
+        }
+    }
+    state->run();
+
+    std::unique_lock<std::mutex> lock(state->mtx);
+    state->cond.wait(lock, [&]() -> bool
+                     { return state->done == state->chunks; });
+    if(state->error)
+    {
+        std::rethrow_exception(state->error);
+    }
+}
+
+// 对[first, last)中的每个下标范围执行func(begin, end)，下标相对于first
+template<typename RandomIt, typename Func>
+void parallelForRange(ThreadPool &pool, RandomIt first, RandomIt last, Func&& func)
+{
+    size_t n = std::distance(first, last);
+    size_t chunks = parallelChunkCount(pool, n);
+    parallelChunks(pool, chunks, [&](size_t chunk)
+    {
+        func(parallelChunkBegin(n, chunks, chunk), parallelChunkBegin(n, chunks, chunk + 1));
+    });
+}
+
+// out[i] = op(first[i])
+template<typename RandomIt, typename OutIt, typename UnaryOp>
+OutIt parallelTransform(ThreadPool &pool, RandomIt first, RandomIt last, OutIt out, UnaryOp op)
+{
+    parallelForRange(pool, first, last, [&](size_t begin, size_t end)
+    {
+        std::transform(first + begin, first + end, out + begin, op);
+    });
+    return out + std::distance(first, last);
+}
+
+// reduce(init, transform(first[0]), transform(first[1]), ...)，reduce需要满足结合律
+template<typename RandomIt, typename T, typename ReduceOp, typename TransformOp>
+T parallelTransformReduce(ThreadPool &pool, RandomIt first, RandomIt last, T init, ReduceOp reduce, TransformOp transform)
+{
+    size_t n = std::distance(first, last);
+    if(n == 0)
+    {
+        return init;
+    }
+    size_t chunks = parallelChunkCount(pool, n);
+    std::vector<T> partial(chunks, init);
+    parallelChunks(pool, chunks, [&](size_t chunk)
+    {
+        RandomIt begin = first + parallelChunkBegin(n, chunks, chunk);
+        RandomIt end = first + parallelChunkBegin(n, chunks, chunk + 1);
+        // 每块以第一个元素为初值，避免init被重复累加
+        T acc = transform(*begin);
+        partial[chunk] = std::transform_reduce(begin + 1, end, std::move(acc), reduce, transform);
+    });
+
+    T result = std::move(init);
+    for(auto &value : partial)
+    {
+        result = reduce(std::move(result), std::move(value));
+    }
+    return result;
+}
+
+// 三步的分块扫描：并行求每块的和，顺序求块间前缀，再并行做带偏移的块内扫描
+// offset为每块之前所有元素的累计值，exclusive为true时offset[0]为init
+template<typename RandomIt, typename OutIt, typename T, typename BinaryOp>
+OutIt parallelScanImpl(ThreadPool &pool, RandomIt first, RandomIt last, OutIt out, T init, BinaryOp op, bool exclusive)
+{
+    size_t n = std::distance(first, last);
+    if(n == 0)
+    {
+        return out;
+    }
+    size_t chunks = parallelChunkCount(pool, n);
+
+    std::vector<T> sums(chunks, init);
+    parallelChunks(pool, chunks, [&](size_t chunk)
+    {
+        RandomIt begin = first + parallelChunkBegin(n, chunks, chunk);
+        RandomIt end = first + parallelChunkBegin(n, chunks, chunk + 1);
+        T acc = *begin;
+        for(++begin; begin != end; ++begin)
+        {
+            acc = op(std::move(acc), *begin);
+        }
+        sums[chunk] = std::move(acc);
+    });
+
+    std::vector<T> offsets(chunks, init);
+    for(size_t chunk = 1; chunk < chunks; ++chunk)
+    {
+        offsets[chunk] = (chunk == 1 && !exclusive) ? sums[0] : op(offsets[chunk - 1], sums[chunk - 1]);
+    }
+
+    parallelChunks(pool, chunks, [&](size_t chunk)
+    {
+        size_t begin = parallelChunkBegin(n, chunks, chunk);
+        size_t end = parallelChunkBegin(n, chunks, chunk + 1);
+        if(exclusive)
+        {
+            std::exclusive_scan(first + begin, first + end, out + begin, offsets[chunk], op);
+        }
+        else if(chunk == 0)
+        {
+            std::inclusive_scan(first + begin, first + end, out + begin, op);
+        }
+        else
+        {
+            std::inclusive_scan(first + begin, first + end, out + begin, op, offsets[chunk]);
+        }
+    });
+    return out + n;
+}
+
+// out[i] = first[0] op first[1] op ... op first[i]，op需要满足结合律，out可以等于first
+template<typename RandomIt, typename OutIt, typename BinaryOp>
+OutIt parallelInclusiveScan(ThreadPool &pool, RandomIt first, RandomIt last, OutIt out, BinaryOp op)
+{
+    using T = typename std::iterator_traits<RandomIt>::value_type;
+    return parallelScanImpl(pool, first, last, out, T(), op, false);
+}
+
+template<typename RandomIt, typename OutIt>
+OutIt parallelInclusiveScan(ThreadPool &pool, RandomIt first, RandomIt last, OutIt out)
+{
+    return parallelInclusiveScan(pool, first, last, out, std::plus<>());
+}
+
+// out[i] = init op first[0] op ... op first[i - 1]，op需要满足结合律，out可以等于first
+template<typename RandomIt, typename OutIt, typename T, typename BinaryOp>
+OutIt parallelExclusiveScan(ThreadPool &pool, RandomIt first, RandomIt last, OutIt out, T init, BinaryOp op)
+{
+    return parallelScanImpl(pool, first, last, out, std::move(init), op, true);
+}
+
+template<typename RandomIt, typename OutIt, typename T>
+OutIt parallelExclusiveScan(ThreadPool &pool, RandomIt first, RandomIt last, OutIt out, T init)
+{
+    return parallelExclusiveScan(pool, first, last, out, std::move(init), std::plus<>());
+}
+
+// 并行归并排序：先并行对每块std::sort，再逐轮两两归并
+// 每轮中较大的归并按第一个序列的等分点和第二个序列的lower_bound切成多段，各段并行std::merge
+template<typename RandomIt, typename Compare>
+void parallelSort(ThreadPool &pool, RandomIt first, RandomIt last, Compare comp)
+{
+    using T = typename std::iterator_traits<RandomIt>::value_type;
+    size_t n = std::distance(first, last);
+    size_t chunks = parallelChunkCount(pool, n);
+    if(chunks == 1)
+    {
+        std::sort(first, last, comp);
+        return;
+    }
+
+    std::vector<size_t> bounds(chunks + 1);
+    for(size_t chunk = 0; chunk <= chunks; ++chunk)
+    {
+        bounds[chunk] = parallelChunkBegin(n, chunks, chunk);
+    }
+    parallelChunks(pool, chunks, [&](size_t chunk)
+    {
+        std::sort(first + bounds[chunk], first + bounds[chunk + 1], comp);
+    });
+
+    std::vector<T> buffer(std::make_move_iterator(first), std::make_move_iterator(last));
+    bool inBuffer = true; // 当前的有序段在buffer中还是在原区间中
+    while(bounds.size() > 2)
+    {
+        size_t pairs = (bounds.size() - 1) / 2;
+        size_t parts = std::max<size_t>(1, chunks / pairs); // 每个归并切成的段数
+        auto mergeRound = [&](auto src, auto dst)
+        {
+            // 先算出所有切分点再归并，避免归并时移走的元素正被别的段用来二分查找
+            // 第一个序列按等分点切分，第二个序列中严格小于切分元素的部分排在它前面，保证各段首尾相接
+            std::vector<std::pair<size_t, size_t>> splits(pairs * (parts + 1));
+            parallelChunks(pool, splits.size(), [&](size_t job)
+            {
+                size_t pair = job / (parts + 1);
+                size_t k = job % (parts + 1);
+                size_t lo = bounds[2 * pair];
+                size_t mid = bounds[2 * pair + 1];
+                size_t hi = bounds[2 * pair + 2];
+                size_t a = lo + (mid - lo) * k / parts;
+                if(k == 0)
+                {
+                    splits[job] = {lo, mid};
+                }
+                else if(a == mid)
+                {
+                    splits[job] = {mid, hi};
+                }
+                else
+                {
+                    splits[job] = {a, (size_t)(std::lower_bound(src + mid, src + hi, src[a], comp) - src)};
+                }
+            });
+
+            parallelChunks(pool, pairs * parts, [&](size_t job)
+            {
+                size_t pair = job / parts;
+                size_t lo = bounds[2 * pair];
+                size_t mid = bounds[2 * pair + 1];
+                auto from = splits[job + pair];
+                auto to = splits[job + pair + 1];
+                std::merge(std::make_move_iterator(src + from.first), std::make_move_iterator(src + to.first),
+                           std::make_move_iterator(src + from.second), std::make_move_iterator(src + to.second),
+                           dst + lo + (from.first - lo) + (from.second - mid), comp);
+            });
+        };
+        if(inBuffer)
+        {
+            mergeRound(buffer.begin(), first);
+        }
+        else
+        {
+            mergeRound(first, buffer.begin());
+        }
+
+        // 奇数个段时最后一段没有参与归并，直接搬过去
+        if((bounds.size() - 1) % 2 == 1)
+        {
+            size_t lo = bounds[bounds.size() - 2];
+            if(inBuffer)
+            {
+                std::move(buffer.begin() + lo, buffer.end(), first + lo);
+            }
+            else
+            {
+                std::move(first + lo, last, buffer.begin() + lo);
+            }
+        }
+
+        std::vector<size_t> next;
+        for(size_t i = 0; i < bounds.size(); i += 2)
+        {
+            next.push_back(bounds[i]);
+        }
+        if(next.back() != n)
+        {
+            next.push_back(n);
+        }
+        bounds.swap(next);
+        inBuffer = !inBuffer;
+    }
+
+    if(inBuffer)
+    {
+        parallelForRange(pool, first, last, [&](size_t begin, size_t end)
+        {
+            std::move(buffer.begin() + begin, buffer.begin() + end, first + begin);
+        });
+    }
+}
+
+template<typename RandomIt>
+void parallelSort(ThreadPool &pool, RandomIt first, RandomIt last)
+{
+    parallelSort(pool, first, last, std::less<>());
+}
+
+// 返回第一个满足pred的元素，没有则返回last
+// 各块共享当前找到的最小下标，位于它之后的块和块内剩余部分直接跳过
+template<typename RandomIt, typename Pred>
+RandomIt parallelFindIf(ThreadPool &pool, RandomIt first, RandomIt last, Pred pred)
+{
+    const size_t CHECK_INTERVAL = 1024; // 块内每隔多少个元素检查一次是否可以提前结束
+    size_t n = std::distance(first, last);
+    std::atomic<size_t> found(n);
+    parallelForRange(pool, first, last, [&](size_t begin, size_t end)
+    {
+        for(size_t i = begin; i < end; ++i)
+        {
+            if((i - begin) % CHECK_INTERVAL == 0 && found.load(std::memory_order_relaxed) < i)
+            {
+                return;
+            }
+            if(pred(first[i]))
+            {
+                size_t cur = found.load(std::memory_order_relaxed);
+                while(i < cur && !found.compare_exchange_weak(cur, i))
+                {}
+                return;
+            }
+        }
+    });
+    return first + found.load();
+}
+
+// 稳定划分：满足pred的元素按原顺序排在前面，返回划分点
+// 先并行计算每个元素的pred并统计每块满足的个数，求出每块在结果中的写入位置，再并行搬到缓冲区后搬回
+template<typename RandomIt, typename Pred>
+RandomIt parallelStablePartition(ThreadPool &pool, RandomIt first, RandomIt last, Pred pred)
+{
+    using T = typename std::iterator_traits<RandomIt>::value_type;
+    size_t n = std::distance(first, last);
+    size_t chunks = parallelChunkCount(pool, n);
+
+    std::vector<char> flags(n);
+    std::vector<size_t> trues(chunks + 1, 0);
+    parallelChunks(pool, chunks, [&](size_t chunk)
+    {
+        size_t count = 0;
+        for(size_t i = parallelChunkBegin(n, chunks, chunk); i < parallelChunkBegin(n, chunks, chunk + 1); ++i)
+        {
+            flags[i] = pred(first[i]) ? 1 : 0;
+            count += flags[i];
+        }
+        trues[chunk + 1] = count;
+    });
+    std::partial_sum(trues.begin(), trues.end(), trues.begin());
+    size_t total = trues[chunks];
+
+    std::vector<T> buffer(std::make_move_iterator(first), std::make_move_iterator(last));
+    parallelChunks(pool, chunks, [&](size_t chunk)
+    {
+        size_t begin = parallelChunkBegin(n, chunks, chunk);
+        size_t t = trues[chunk]; // 本块满足pred的元素的写入位置
+        size_t f = total + begin - trues[chunk]; // 本块不满足pred的元素的写入位置
+        for(size_t i = begin; i < parallelChunkBegin(n, chunks, chunk + 1); ++i)
+        {
+            first[flags[i] ? t++ : f++] = std::move(buffer[i]);
+        }
+    });
+    return first + total;
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,336 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include"threadpool.h"
+
+#include<csignal>
+#include<cerrno>
+#include<map>
+#include<ostream>
+#include<ctime>
+#include<sys/time.h>
+
+/*
+example:
+ThreadPool pool;
+pool.start(8);
+
+auto profiler = std::make_shared<TaskProfiler>();
+pool.setTaskObserver(profiler); // 按标签统计排队时间和执行时间
+profiler->start(99);            // 每个CPU每秒大约采样99次，按标签统计CPU时间
+
+auto compressed = pool.submitTaggedTask("compress", compress, block);
+auto sum = pool.submitTaggedTask("checksum", checksum, block);
+compressed.get(); // 任务在结果交给future之前报告给观察者，future就绪后停止不会漏掉这个任务
+sum.get();
+
+profiler->stop();
+profiler->dumpCollapsed(std::cout); // 输出可以直接交给flamegraph.pl
+*/
+// 按任务标签采样的性能分析器：ITIMER_PROF按进程消耗的CPU时间定时发出SIGPROF，信号由正在消耗CPU的线程处理，
+// 信号处理函数读取该线程的TaskTrace，把样本记到对应的（资源组，标签）上；排队时间和执行时间通过TaskObserver统计
+// 统计表是定长的开放寻址哈希表，信号处理函数中不加锁、不分配内存；同一时刻只能有一个分析器在采样
+// 内核按时钟节拍发送SIGPROF，hz高于内核的时钟频率时实际样本会变少，所以CPU时间不用 样本数 * 采样间隔 估算，
+// 而是把采样期间进程实际消耗的CPU时间（CLOCK_PROCESS_CPUTIME_ID）按样本比例分摊
+const size_t PROFILER_TABLE_SIZE = 1024; // 统计表的槽数，必须是2的幂，超出的（资源组，标签）组合只计入dropped
+
+class TaskProfiler : public TaskObserver
+{
+public:
+    // 一个（资源组，标签）的统计结果
+    struct TagStats
+    {
+        std::string group;
+        std::string tag; // 没有标签的任务为"[untagged]"
+        uint64_t samples; // CPU采样次数
+        std::chrono::nanoseconds cpu; // 估算的CPU时间 = 采样期间进程消耗的CPU时间 * 采样次数 / 总样本数
+        uint64_t tasks; // 执行完成的任务数量
+        std::chrono::nanoseconds wait; // 累计排队时间
+        std::chrono::nanoseconds run; // 累计执行时间（墙上时间）
+    };
+
+    TaskProfiler()
+        : cpuStartNs_(0)
+        , cpuNs_(0)
+        , totalSamples_(0)
+        , idleSamples_(0)
+        , otherSamples_(0)
+        , dropped_(0)
+    {}
+
+    ~TaskProfiler()
+    {
+        stop();
+    }
+
+    TaskProfiler(const TaskProfiler &) = delete;
+    TaskProfiler &operator=(const TaskProfiler &) = delete;
+
+    // 开始采样，hz为每秒CPU时间的采样次数；已经有分析器在采样时返回false
+    bool start(int hz = 99)
+    {
+        TaskProfiler *expected = nullptr;
+        if(hz <= 0 || !active().compare_exchange_strong(expected, this))
+        {
+            return false;
+        }
+
+        // 信号处理函数安装后不再卸载，停止后到达的信号直接忽略，避免SIGPROF的默认动作结束进程
+        static std::once_flag installed;
+        std::call_once(installed, []()
+        {
+            struct sigaction action{};
+            action.sa_sigaction = &TaskProfiler::onSignal;
+            action.sa_flags = SA_RESTART | SA_SIGINFO;
+            sigemptyset(&action.sa_mask);
+            ::sigaction(SIGPROF, &action, nullptr);
+        });
+
+        cpuStartNs_ = processCpuNs();
+        long us = std::max(1L, 1000000L / hz);
+        itimerval timer{};
+        timer.it_interval.tv_sec = us / 1000000;
+        timer.it_interval.tv_usec = us % 1000000;
+        timer.it_value = timer.it_interval;
+        ::setitimer(ITIMER_PROF, &timer, nullptr);
+        return true;
+    }
+
+    // 停止采样，返回时不会再有信号处理函数访问当前对象
+    void stop()
+    {
+        if(active().load() != this)
+        {
+            return;
+        }
+        itimerval timer{};
+        ::setitimer(ITIMER_PROF, &timer, nullptr);
+        cpuNs_ += processCpuNs() - cpuStartNs_;
+        active().store(nullptr);
+        while(handlersRunning().load() > 0)
+        {
+            std::this_thread::yield();
+        }
+    }
+
+    void onTaskDone(const char *group, const char *tag, std::chrono::nanoseconds wait, std::chrono::nanoseconds run) override
+    {
+        Entry *entry = find(group, tag);
+        if(entry == nullptr)
+        {
+            dropped_++;
+            return;
+        }
+        entry->tasks.fetch_add(1, std::memory_order_relaxed);
+        entry->waitNs.fetch_add(wait.count(), std::memory_order_relaxed);
+        entry->runNs.fetch_add(run.count(), std::memory_order_relaxed);
+    }
+
+    // 按（资源组，标签）汇总的统计结果，相同内容的标签字符串合并在一起
+    std::vector<TagStats> report() const
+    {
+        // 按样本比例分摊采样期间的进程CPU时间，正在采样时算到当前为止
+        uint64_t totalSamples = totalSamples_;
+        int64_t cpuNs = cpuNs_ + (active().load() == this ? processCpuNs() - cpuStartNs_ : 0);
+        double cpuPerSample = totalSamples == 0 ? 0.0 : (double)cpuNs / totalSamples;
+
+        std::map<std::pair<std::string, std::string>, TagStats> merged;
+        for(const Entry &entry : table_)
+        {
+            if(entry.state.load(std::memory_order_acquire) != ENTRY_READY)
+            {
+                continue;
+            }
+            std::string group = entry.group == nullptr ? std::string() : std::string(entry.group);
+            std::string tag = entry.tag == nullptr ? std::string("[untagged]") : std::string(entry.tag);
+            auto it = merged.emplace(std::make_pair(group, tag),
+                                     TagStats{group, tag, 0, std::chrono::nanoseconds(0), 0,
+                                              std::chrono::nanoseconds(0), std::chrono::nanoseconds(0)}).first;
+            TagStats &stats = it->second;
+            uint64_t samples = entry.samples.load(std::memory_order_relaxed);
+            stats.samples += samples;
+            stats.cpu += std::chrono::nanoseconds((int64_t)(samples * cpuPerSample));
+            stats.tasks += entry.tasks.load(std::memory_order_relaxed);
+            stats.wait += std::chrono::nanoseconds(entry.waitNs.load(std::memory_order_relaxed));
+            stats.run += std::chrono::nanoseconds(entry.runNs.load(std::memory_order_relaxed));
+        }
+
+        std::vector<TagStats> result;
+        for(auto &item : merged)
+        {
+            result.emplace_back(std::move(item.second));
+        }
+        return result;
+    }
+
+    // 按flamegraph的折叠栈格式输出CPU样本：每行"ThreadPool;资源组;标签 样本数"
+    // 工作线程在等待或调度时的样本记为ThreadPool;[idle]，其他线程的样本记为[non-worker]
+    void dumpCollapsed(std::ostream &out) const
+    {
+        for(const TagStats &stats : report())
+        {
+            if(stats.samples > 0)
+            {
+                out << "ThreadPool;" << frame(stats.group) << ";" << frame(stats.tag) << " " << stats.samples << "\n";
+            }
+        }
+        if(idleSamples_ > 0)
+        {
+            out << "ThreadPool;[idle] " << idleSamples_ << "\n";
+        }
+        if(otherSamples_ > 0)
+        {
+            out << "[non-worker] " << otherSamples_ << "\n";
+        }
+    }
+
+    // 统计表放不下而丢弃的样本和任务数量
+    uint64_t dropped() const
+    {
+        return dropped_;
+    }
+
+    // 清空计数，已经出现过的（资源组，标签）仍然占用统计表的槽
+    void reset()
+    {
+        for(Entry &entry : table_)
+        {
+            entry.samples = 0;
+            entry.tasks = 0;
+            entry.waitNs = 0;
+            entry.runNs = 0;
+        }
+        idleSamples_ = 0;
+        otherSamples_ = 0;
+        dropped_ = 0;
+        totalSamples_ = 0;
+        cpuNs_ = 0;
+        if(active().load() == this)
+        {
+            cpuStartNs_ = processCpuNs();
+        }
+    }
+
+private:
+    enum
+    {
+        ENTRY_EMPTY,
+        ENTRY_WRITING, // 正在写入键，其他线程跳过这个槽
+        ENTRY_READY,
+    };
+
+    struct Entry
+    {
+        std::atomic<int> state{ENTRY_EMPTY};
+        const char *group = nullptr; // 按指针比较，state变为ENTRY_READY之后不再修改；资源组名字是驻留的字符串，一直有效
+        const char *tag = nullptr;
+        std::atomic<uint64_t> samples{0};
+        std::atomic<uint64_t> tasks{0};
+        std::atomic<uint64_t> waitNs{0};
+        std::atomic<uint64_t> runNs{0};
+    };
+
+    static std::atomic<TaskProfiler *> &active()
+    {
+        static std::atomic<TaskProfiler *> profiler{nullptr};
+        return profiler;
+    }
+
+    // 正在执行的信号处理函数数量，stop等它归零后才返回
+    static std::atomic<int> &handlersRunning()
+    {
+        static std::atomic<int> count{0};
+        return count;
+    }
+
+    static void onSignal(int, siginfo_t *, void *)
+    {
+        int savedErrno = errno;
+        handlersRunning()++;
+        TaskProfiler *profiler = active().load();
+        if(profiler != nullptr)
+        {
+            profiler->sample();
+        }
+        handlersRunning()--;
+        errno = savedErrno;
+    }
+
+    // 在信号处理函数中调用，被打断的线程就是消耗CPU的线程
+    void sample()
+    {
+        totalSamples_++;
+        const TaskTrace &trace = currentTaskTrace();
+        if(!trace.worker)
+        {
+            otherSamples_++;
+            return;
+        }
+        if(!trace.running)
+        {
+            idleSamples_++;
+            return;
+        }
+        std::atomic_signal_fence(std::memory_order_seq_cst);
+        Entry *entry = find(trace.group, trace.tag);
+        if(entry == nullptr)
+        {
+            dropped_++;
+            return;
+        }
+        entry->samples.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // 查找或者插入（资源组，标签）对应的槽，不加锁，可以在信号处理函数中调用
+    // 遇到其他线程正在写入的槽直接跳过，同一个组合可能占用多个槽，汇总时合并
+    Entry *find(const char *group, const char *tag)
+    {
+        size_t hash = (reinterpret_cast<uintptr_t>(group) * 31 + reinterpret_cast<uintptr_t>(tag)) * 0x9E3779B97F4A7C15ull;
+        for(size_t i = 0; i < PROFILER_TABLE_SIZE; ++i)
+        {
+            Entry &entry = table_[(hash + i) & (PROFILER_TABLE_SIZE - 1)];
+            int state = entry.state.load(std::memory_order_acquire);
+            if(state == ENTRY_EMPTY)
+            {
+                if(entry.state.compare_exchange_strong(state, ENTRY_WRITING, std::memory_order_acquire))
+                {
+                    entry.group = group;
+                    entry.tag = tag;
+                    entry.state.store(ENTRY_READY, std::memory_order_release);
+                    return &entry;
+                }
+            }
+            if(state == ENTRY_READY && entry.group == group && entry.tag == tag)
+            {
+                return &entry;
+            }
+        }
+        return nullptr;
+    }
+
+    // 进程所有线程消耗的CPU时间
+    static int64_t processCpuNs()
+    {
+        timespec ts{};
+        ::clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+        return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+    }
+
+    // flamegraph用分号分隔栈帧、用空格分隔样本数，名字中的这两种字符替换掉
+    static std::string frame(std::string name)
+    {
+        std::replace(name.begin(), name.end(), ';', '_');
+        std::replace(name.begin(), name.end(), ' ', '_');
+        return name.empty() ? std::string("[unnamed]") : name;
+    }
+
+    Entry table_[PROFILER_TABLE_SIZE];
+    int64_t cpuStartNs_; // 本次采样开始时进程的CPU时间，由调用start、stop、report的线程访问
+    int64_t cpuNs_; // 之前各次采样期间累计的进程CPU时间
+    std::atomic<uint64_t> totalSamples_; // 所有样本，包括空闲、非工作线程和丢弃的样本
+    std::atomic<uint64_t> idleSamples_; // 工作线程在等待或调度时的样本
+    std::atomic<uint64_t> otherSamples_; // 非工作线程的样本
+    std::atomic<uint64_t> dropped_;
+};
+
+#endif
@@ -0,0 +1,176 @@
+#ifndef STRAND_H
+#define STRAND_H
+
+#include"threadpool.h"
+
+/*
+example:
+ThreadPool pool;
+pool.start(8);
+
+// 每个账户一个strand，同一个账户的任务按提交顺序逐个执行，不同账户之间并行
+auto account = std::make_shared<Strand>(pool);
+account->submitTask(deposit, 100);
+std::future<long> balance = account->submitTask(getBalance);
+*/
+// 串行执行器：提交到同一个strand的任务按提交顺序执行，任何时刻最多只有一个在执行，不需要专门的线程
+// 任务先放进strand自己的无锁队列（Vyukov侵入式MPSC队列），只有一个排空任务会进入线程池的调度队列，
+// 排空任务每次最多执行STRAND_BATCH个任务后重新提交自己，避免一个繁忙的strand长期占住工作线程
+// 空闲的strand只有几个指针大小，可以为每个实体创建一个；strand必须由std::make_shared创建
+const int STRAND_BATCH = 64;
+
+class Strand : public std::enable_shared_from_this<Strand>
+{
+public:
+    explicit Strand(ThreadPool &pool)
+        : pool_(pool)
+        , head_(&stub_)
+        , tail_(&stub_)
+        , pending_(0)
+    {}
+
+    // 队列中的任务都由排空任务持有的shared_ptr保活，走到析构时队列一定是空的
+    ~Strand() = default;
+
+    Strand(const Strand &) = delete;
+    Strand &operator=(const Strand &) = delete;
+
+    // 提交任务，用法与ThreadPool::submitTask相同
+    template<typename Func, typename... Args>
+    auto submitTask(Func&& func, Args&&... args) ->std::future<decltype(func(args...))>
+    {
+        using RType = decltype(func(args...));
+        auto node = new TaskNode<RType>(std::bind(std::forward<Func>(func), std::forward<Args>(args)...));
+        std::future<RType> result = node->task.get_future();
+        push(node);
+
+        // 从空闲变为有任务的提交者负责把排空任务交给线程池
+        if(pending_.fetch_add(1, std::memory_order_acq_rel) == 0)
+        {
+            schedule();
+        }
+        return result;
+    }
+
+private:
+    // 队列节点，stub_只用来做哨兵
+    struct Node
+    {
+        virtual ~Node() = default;
+        virtual void run()
+        {}
+
+        std::atomic<Node *> next{nullptr};
+    };
+
+    template<typename R>
+    struct TaskNode : Node
+    {
+        template<typename Call>
+        explicit TaskNode(Call&& call)
+            : task(std::forward<Call>(call))
+        {}
+
+        void run() override
+        {
+            task();
+        }
+
+        std::packaged_task<R()> task;
+    };
+
+    // 多个提交者并发入队
+    void push(Node *node)
+    {
+        node->next.store(nullptr, std::memory_order_relaxed);
+        Node *prev = head_.exchange(node, std::memory_order_acq_rel);
+        prev->next.store(node, std::memory_order_release);
+    }
+
+    // 只有排空任务出队；提交者交换了head_但还没链接next时返回nullptr
+    Node *pop()
+    {
+        Node *tail = tail_;
+        Node *next = tail->next.load(std::memory_order_acquire);
+        if(tail == &stub_)
+        {
+            if(next == nullptr)
+            {
+                return nullptr;
+            }
+            tail_ = next;
+            tail = next;
+            next = next->next.load(std::memory_order_acquire);
+        }
+        if(next != nullptr)
+        {
+            tail_ = next;
+            return tail;
+        }
+        if(tail != head_.load(std::memory_order_acquire))
+        {
+            return nullptr;
+        }
+        // 只剩最后一个节点，放回哨兵后才能把它取出来
+        push(&stub_);
+        next = tail->next.load(std::memory_order_acquire);
+        if(next != nullptr)
+        {
+            tail_ = next;
+            return tail;
+        }
+        return nullptr;
+    }
+
+    // 把排空任务交给线程池，线程池拒绝时（队列满或者准入策略拒绝）在当前线程排空，保证任务不会丢失
+    void schedule()
+    {
+        if(!submitDrain())
+        {
+            drain();
+        }
+    }
+
+    bool submitDrain()
+    {
+        std::shared_ptr<Strand> self = shared_from_this();
+        auto result = pool_.trySubmitTask(nullptr, [self]() { self->drain(); });
+        return result.status == SubmitStatus::OK;
+    }
+
+    void drain()
+    {
+        for(;;)
+        {
+            for(int i = 0; i < STRAND_BATCH; ++i)
+            {
+                // pending_大于0说明一定有节点，出队失败只是提交者还没链接完成，稍等即可
+                Node *node;
+                while((node = pop()) == nullptr)
+                {
+                    std::this_thread::yield();
+                }
+                node->run();
+                delete node;
+
+                if(pending_.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                {
+                    return;
+                }
+            }
+            // 还有任务，重新排队让其他任务也有机会执行；线程池拒绝时继续在这里执行
+            if(submitDrain())
+            {
+                return;
+            }
+        }
+    }
+
+    ThreadPool &pool_;
+    Node stub_; // 哨兵节点
+    std::atomic<Node *> head_; // 提交者入队的位置
+    Node *tail_; // 排空任务出队的位置，只被当前的排空任务访问
+    std::atomic<size_t> pending_; // 已提交还没执行完的任务数量，从0变为1的提交者负责调度
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,250 @@
+#undef NDEBUG // 测试依赖assert
+#include<cassert>
+#include"admission.h"
+
+// 准入策略：令牌桶的补充、按标签限速和onCancel退还，CoDel进入和退出拒绝状态，AIMD在取消和完成时的并发计数
+// 策略的状态先直接调用接口检查，再装到线程池上检查提交路径的调用顺序
+
+// 等待条件成立，超时返回false
+template<typename Pred>
+static bool waitUntil(Pred pred, std::chrono::milliseconds timeout = std::chrono::seconds(5))
+{
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    while(!pred())
+    {
+        if(std::chrono::steady_clock::now() > deadline)
+        {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+}
+
+// 可以开关的拒绝策略，排在其他策略后面，用来触发前面策略的onCancel
+class Switch : public AdmissionPolicy
+{
+public:
+    bool admit(const char *) override
+    {
+        return !reject;
+    }
+
+    std::atomic<bool> reject{false};
+};
+
+// 占住线程池唯一的工作线程，直到release
+struct Blocker
+{
+    explicit Blocker(ThreadPool &pool)
+    {
+        std::promise<void> started;
+        std::shared_future<void> released = release.get_future().share();
+        done = pool.submitTask([&started, released]() { started.set_value(); released.wait(); });
+        started.get_future().wait();
+    }
+
+    void unblock()
+    {
+        release.set_value();
+        done.get();
+    }
+
+    std::promise<void> release;
+    std::future<void> done;
+};
+
+static void testTokenBucket()
+{
+    // 突发上限和按标签独立的桶，速率为0时不补充
+    TokenBucketPolicy burst(0, 3);
+    for(int i = 0; i < 3; ++i)
+    {
+        assert(burst.admit("a"));
+    }
+    assert(!burst.admit("a"));
+    assert(burst.admit("b"));
+    assert(burst.admit(nullptr));
+
+    // 单独设置的标签使用自己的速率和突发上限
+    burst.setLimit("vip", 0, 5);
+    for(int i = 0; i < 5; ++i)
+    {
+        assert(burst.admit("vip"));
+    }
+    assert(!burst.admit("vip"));
+
+    // onCancel退还令牌，不超过突发上限
+    TokenBucketPolicy refund(0, 1);
+    assert(refund.admit("a"));
+    assert(!refund.admit("a"));
+    refund.onCancel("a");
+    refund.onCancel("a");
+    assert(refund.admit("a"));
+    assert(!refund.admit("a"));
+
+    // 按速率补充：每秒10个令牌，用完后等150毫秒补回一个
+    TokenBucketPolicy rate(10, 1);
+    assert(rate.admit("a"));
+    assert(!rate.admit("a"));
+    std::this_thread::sleep_for(std::chrono::milliseconds(150));
+    assert(rate.admit("a"));
+
+    // 线程池中：后面的策略拒绝或者队列满时，令牌桶的令牌被退还
+    ThreadPool pool;
+    pool.setTaskQueMaxThreshHold(1);
+    pool.start(1);
+    auto bucket = std::make_shared<TokenBucketPolicy>(0, 2);
+    auto sw = std::make_shared<Switch>();
+    pool.addAdmissionPolicy(bucket);
+    pool.addAdmissionPolicy(sw);
+
+    sw->reject = true;
+    for(int i = 0; i < 5; ++i)
+    {
+        assert(pool.trySubmitTask("t", []() {}).status == SubmitStatus::REJECTED);
+    }
+    sw->reject = false;
+
+    // 工作线程被占住时（占用标签nullptr的令牌），队列只能放一个任务
+    Blocker blocker(pool);
+    assert(pool.trySubmitTask("t", []() {}).status == SubmitStatus::OK);
+    assert(pool.trySubmitTask("t", []() {}).status == SubmitStatus::QUEUE_FULL);
+    blocker.unblock();
+    assert(pool.trySubmitTask("t", []() {}).status == SubmitStatus::OK);
+    assert(pool.trySubmitTask("t", []() {}).status == SubmitStatus::REJECTED);
+}
+
+static void testCoDel()
+{
+    using namespace std::chrono;
+    const auto target = milliseconds(5);
+    const auto interval = milliseconds(20);
+
+    // 排队时间超标不满一个interval时不拒绝
+    CoDelPolicy codel(target, interval);
+    codel.onStart(nullptr, milliseconds(10));
+    assert(!codel.overloaded());
+    assert(codel.admit(nullptr));
+
+    // 持续超标一个interval后进入拒绝状态：立即拒绝一个，之后按interval / sqrt(count)的间隔拒绝
+    std::this_thread::sleep_for(interval + milliseconds(5));
+    codel.onStart(nullptr, milliseconds(10));
+    assert(codel.overloaded());
+    assert(!codel.admit(nullptr));
+    assert(codel.admit(nullptr));
+    std::this_thread::sleep_for(interval + milliseconds(5));
+    assert(!codel.admit(nullptr));
+    assert(codel.admit(nullptr));
+
+    // 排队时间回到target以下时退出拒绝状态，重新计时
+    codel.onStart(nullptr, milliseconds(1));
+    assert(!codel.overloaded());
+    assert(codel.admit(nullptr));
+    codel.onStart(nullptr, milliseconds(10));
+    assert(!codel.overloaded());
+
+    // 线程池中：任务积压让出队的排队时间持续超标，提交开始被拒绝
+    ThreadPool pool;
+    pool.start(1);
+    auto policy = std::make_shared<CoDelPolicy>(target, interval);
+    pool.addAdmissionPolicy(policy);
+    std::vector<std::future<void>> results;
+    {
+        Blocker blocker(pool);
+        for(int i = 0; i < 10; ++i)
+        {
+            results.emplace_back(pool.submitTask([]() { std::this_thread::sleep_for(milliseconds(10)); }));
+        }
+        std::this_thread::sleep_for(interval);
+        blocker.unblock();
+    }
+    assert(waitUntil([&]() { return policy->overloaded(); }));
+    bool rejected = false;
+    for(int i = 0; i < 100 && !rejected; ++i)
+    {
+        rejected = pool.trySubmitTask(nullptr, []() {}).status == SubmitStatus::REJECTED;
+    }
+    assert(rejected);
+    for(auto &result : results)
+    {
+        result.get();
+    }
+}
+
+static void testAimd()
+{
+    using namespace std::chrono;
+
+    // 上限为2：已准入还没完成的任务达到上限后拒绝，取消和完成都归还名额
+    AimdConcurrencyPolicy aimd(2, 1, 4, milliseconds(10));
+    assert(aimd.admit(nullptr));
+    assert(aimd.admit(nullptr));
+    assert(!aimd.admit(nullptr));
+    aimd.onCancel(nullptr);
+    assert(aimd.admit(nullptr));
+    assert(!aimd.admit(nullptr));
+
+    // 延迟达标时加性增长：2 + 1/2
+    aimd.onComplete(nullptr, milliseconds(1));
+    assert(aimd.limit() == 2.5);
+    assert(aimd.admit(nullptr));
+    assert(!aimd.admit(nullptr));
+
+    // 延迟超标时乘性减少，不低于下限
+    aimd.onComplete(nullptr, milliseconds(100));
+    assert(aimd.limit() == 2.5 * 0.9);
+    for(int i = 0; i < 20; ++i)
+    {
+        aimd.onComplete(nullptr, milliseconds(100));
+        aimd.admit(nullptr);
+    }
+    assert(aimd.limit() == 1);
+
+    // 加性增长不超过上限
+    AimdConcurrencyPolicy capped(4, 1, 4, milliseconds(10));
+    capped.admit(nullptr);
+    capped.onComplete(nullptr, milliseconds(1));
+    assert(capped.limit() == 4);
+
+    // 线程池中：队列满和后面的策略拒绝都归还名额，任务完成后名额全部归还
+    ThreadPool pool;
+    pool.setTaskQueMaxThreshHold(1);
+    pool.start(1);
+    auto policy = std::make_shared<AimdConcurrencyPolicy>(3, 1, 3, seconds(10));
+    auto sw = std::make_shared<Switch>();
+    pool.addAdmissionPolicy(policy);
+    pool.addAdmissionPolicy(sw);
+    {
+        Blocker blocker(pool); // 占用1个名额
+        assert(pool.trySubmitTask(nullptr, []() {}).status == SubmitStatus::OK); // 2个
+        assert(pool.trySubmitTask(nullptr, []() {}).status == SubmitStatus::QUEUE_FULL);
+        sw->reject = true;
+        assert(pool.trySubmitTask(nullptr, []() {}).status == SubmitStatus::REJECTED);
+        sw->reject = false;
+        pool.setQueueCapacity(2);
+        assert(pool.trySubmitTask(nullptr, []() {}).status == SubmitStatus::OK); // 3个
+        assert(pool.trySubmitTask(nullptr, []() {}).status == SubmitStatus::REJECTED);
+        blocker.unblock();
+    }
+    // 名额在onComplete中归还；通过trySubmitTask提交的任务没有保留future，等资源组的任务全部执行完
+    assert(waitUntil([&]()
+    {
+        auto stats = pool.defaultGroup()->stats();
+        return stats.queued == 0 && stats.running == 0;
+    }));
+    for(int i = 0; i < 3; ++i)
+    {
+        assert(policy->admit(nullptr));
+    }
+    assert(!policy->admit(nullptr));
+}
+
+int main()
+{
+    testTokenBucket();
+    testCoDel();
+    testAimd();
+    std::cout << "admission_test passed" << std::endl;
+    return 0;
+}
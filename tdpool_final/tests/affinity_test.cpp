@@ -0,0 +1,49 @@
+#undef NDEBUG // 测试依赖assert
+#include<cassert>
+#include"threadpool.h"
+
+// 亲和性：槽位的线程正忙或者在阻塞区域中时，槽位中的任务由空闲线程窃取，等待这些任务的线程不会饿死
+
+// 任务把后续任务提交到自己的槽位并等待它：槽位的线程一直忙，后续任务由另一个线程执行
+static void testWaitOnOwnSlot()
+{
+    ThreadPool pool;
+    pool.start(2);
+    auto outer = pool.submitTask([&pool]()
+    {
+        int slot = pool.currentWorkerSlot();
+        assert(slot >= 0);
+        auto inner = pool.submitTask(Affinity::worker(slot), [&pool]() { return pool.currentWorkerSlot(); });
+        if(inner.wait_for(std::chrono::seconds(5)) != std::future_status::ready)
+        {
+            return false;
+        }
+        return inner.get() != slot;
+    });
+    assert(outer.get());
+}
+
+// 唯一的工作线程进入阻塞区域，等待提交到自己槽位的任务：补偿线程窃取这个任务
+static void testBlockedOwner()
+{
+    ThreadPool pool;
+    pool.start(1);
+    std::promise<void> done;
+    std::future<void> doneFuture = done.get_future();
+    auto outer = pool.submitTask([&]()
+    {
+        int slot = pool.currentWorkerSlot();
+        pool.submitTask(Affinity::worker(slot), [&done]() { done.set_value(); });
+        ThreadPool::BlockingRegion region;
+        return doneFuture.wait_for(std::chrono::seconds(5)) == std::future_status::ready;
+    });
+    assert(outer.get());
+}
+
+int main()
+{
+    testWaitOnOwnSlot();
+    testBlockedOwner();
+    std::cout << "affinity_test passed" << std::endl;
+    return 0;
+}
@@ -0,0 +1,130 @@
+#undef NDEBUG // 测试依赖assert
+#include<cassert>
+#include<cstdlib>
+#include<cstring>
+#include<fcntl.h>
+#include"asyncio.h"
+
+// AsyncIO的读写、fsync、错误码、回调和析构等待，io_uring和退化模式各跑一遍；线程池拒绝后续处理或者IO任务时的结果
+// 提交队列长度为0时io_uring_setup失败，用来强制走退化模式
+
+static void testReadWrite(ThreadPool &pool, unsigned entries)
+{
+    char path[] = "/tmp/asyncio_testXXXXXX";
+    int fd = ::mkstemp(path);
+    assert(fd >= 0);
+    ::unlink(path);
+
+    AsyncIO io(pool, entries);
+    std::cout << (io.usingIoUring() ? "io_uring" : "blocking io") << std::endl;
+
+    const char text[] = "hello asyncio";
+    std::promise<ssize_t> written;
+    ssize_t n = io.writeAsync(fd, text, sizeof(text), 0, [&](ssize_t res) { written.set_value(res); }).get();
+    assert(n == (ssize_t)sizeof(text));
+    assert(written.get_future().get() == n);
+    assert(io.fsyncAsync(fd).get() == 0);
+
+    char buf[64] = {};
+    assert(io.readAsync(fd, buf, sizeof(buf), 0).get() == (ssize_t)sizeof(text));
+    assert(std::strcmp(buf, text) == 0);
+
+    // 读到文件末尾返回0，错误返回-errno
+    assert(io.readAsync(fd, buf, sizeof(buf), 4096).get() == 0);
+    assert(io.readAsync(-1, buf, sizeof(buf), 0).get() == -EBADF);
+    assert(io.fsyncAsync(-1).get() == -EBADF);
+
+    // 析构时等待所有已提交的IO完成
+    std::vector<std::future<ssize_t>> results;
+    std::vector<char> block(4096, 'x');
+    {
+        AsyncIO batch(pool, entries);
+        for(int i = 0; i < 256; ++i)
+        {
+            results.emplace_back(batch.writeAsync(fd, block.data(), block.size(), (off_t)i * block.size()));
+        }
+    }
+    for(auto &result : results)
+    {
+        assert(result.wait_for(std::chrono::seconds(0)) == std::future_status::ready);
+        assert(result.get() == (ssize_t)block.size());
+    }
+    ::close(fd);
+}
+
+// 线程池队列满时，io_uring模式的后续处理在收割线程中执行，不会阻塞收割线程
+static void testCallbackRejected()
+{
+    ThreadPool pool;
+    pool.setTaskQueMaxThreshHold(1);
+    pool.start(1);
+
+    AsyncIO io(pool);
+    if(!io.usingIoUring())
+    {
+        return;
+    }
+
+    // 占住唯一的工作线程，再排一个任务把队列填满
+    std::promise<void> release;
+    std::shared_future<void> released = release.get_future().share();
+    std::promise<void> started;
+    pool.submitTask([&started, released]() { started.set_value(); released.wait(); });
+    started.get_future().wait();
+    pool.submitTask([]() {});
+
+    char path[] = "/tmp/asyncio_testXXXXXX";
+    int fd = ::mkstemp(path);
+    assert(fd >= 0);
+    ::unlink(path);
+
+    std::promise<std::thread::id> ranOn;
+    auto begin = std::chrono::steady_clock::now();
+    io.writeAsync(fd, "x", 1, 0, [&](ssize_t res) { assert(res == 1); ranOn.set_value(std::this_thread::get_id()); });
+    std::future<std::thread::id> callback = ranOn.get_future();
+    assert(callback.wait_for(std::chrono::seconds(5)) == std::future_status::ready);
+    assert(std::chrono::steady_clock::now() - begin < std::chrono::milliseconds(500));
+    assert(callback.get() != std::this_thread::get_id());
+
+    release.set_value();
+    ::close(fd);
+}
+
+// 拒绝所有任务的准入策略
+class RejectAll : public AdmissionPolicy
+{
+public:
+    bool admit(const char *) override
+    {
+        return false;
+    }
+};
+
+// 退化模式下线程池拒绝IO任务：结果为-EAGAIN（不能和读到文件末尾的0混淆），回调照常执行
+static void testBlockingRejected()
+{
+    ThreadPool pool;
+    pool.start(2);
+    AsyncIO io(pool, 0);
+    assert(!io.usingIoUring());
+    pool.addAdmissionPolicy(std::make_shared<RejectAll>());
+
+    char buf[16];
+    ssize_t seen = 0;
+    assert(io.readAsync(0, buf, sizeof(buf), 0, [&](ssize_t res) { seen = res; }).get() == -EAGAIN);
+    assert(seen == -EAGAIN);
+    assert(io.writeAsync(1, buf, sizeof(buf), 0).get() == -EAGAIN);
+    assert(io.fsyncAsync(1).get() == -EAGAIN);
+}
+
+int main()
+{
+    ThreadPool pool;
+    pool.start(4);
+    testReadWrite(pool, 64);
+    testReadWrite(pool, 0);
+    testCallbackRejected();
+    testBlockingRejected();
+    std::cout << "asyncio_test passed" << std::endl;
+    return 0;
+}
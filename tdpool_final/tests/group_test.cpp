@@ -0,0 +1,213 @@
+#undef NDEBUG // 测试依赖assert
+#include<cassert>
+#include<map>
+#include"threadpool.h"
+
+// 资源组：并发上限、按权重分配线程、removeGroup之后拒绝提交、已排队的任务执行完、执行完后从调度列表中删除；
+// 观察者和完成计数在future就绪之前更新
+
+// 等待条件成立，超时返回false
+template<typename Pred>
+static bool waitUntil(Pred pred, std::chrono::milliseconds timeout = std::chrono::seconds(5))
+{
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    while(!pred())
+    {
+        if(std::chrono::steady_clock::now() > deadline)
+        {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+}
+
+static void spin(std::chrono::microseconds duration)
+{
+    auto deadline = std::chrono::steady_clock::now() + duration;
+    while(std::chrono::steady_clock::now() < deadline)
+    {}
+}
+
+// 并发上限为2的资源组同时最多占用2个线程
+static void testMaxConcurrency()
+{
+    ThreadPool pool;
+    pool.start(4);
+    auto capped = pool.createGroup("capped", 1, 2);
+    std::atomic<int> running{0};
+    std::atomic<int> maxRunning{0};
+    std::vector<std::future<void>> results;
+    for(int i = 0; i < 40; ++i)
+    {
+        results.emplace_back(capped->submitTask([&]()
+        {
+            int now = ++running;
+            int seen = maxRunning.load();
+            while(now > seen && !maxRunning.compare_exchange_weak(seen, now))
+            {}
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            --running;
+        }));
+    }
+    for(auto &result : results)
+    {
+        result.get();
+    }
+    assert(maxRunning <= 2);
+    // 完成计数在结果交给future之前更新
+    assert(capped->stats().completed == 40);
+}
+
+// 两个资源组都有积压时，执行时间按权重分配：权重3的资源组完成的任务明显多于权重1的
+// 启动前把两个资源组都填满，在heavy完成第150个任务时记录light完成的数量，不受提交线程调度的影响
+static void testWeights()
+{
+    ThreadPool pool;
+    auto light = pool.createGroup("light", 1);
+    auto heavy = pool.createGroup("heavy", 3);
+    std::atomic<int> lightDone{0};
+    std::atomic<int> heavyDone{0};
+    std::atomic<int> lightAtSample{-1};
+    std::vector<std::future<void>> results;
+    for(int i = 0; i < 200; ++i)
+    {
+        results.emplace_back(light->submitTask([&]()
+        {
+            spin(std::chrono::microseconds(200));
+            lightDone++;
+        }));
+        results.emplace_back(heavy->submitTask([&]()
+        {
+            spin(std::chrono::microseconds(200));
+            if(++heavyDone == 150)
+            {
+                lightAtSample = lightDone.load();
+            }
+        }));
+    }
+    pool.start(2);
+    for(auto &result : results)
+    {
+        result.get();
+    }
+    assert(lightAtSample >= 0 && lightAtSample < 100);
+}
+
+// 移除资源组：之后的提交被拒绝，已经排队的任务执行完，全部执行完后从调度列表中删除
+static void testRemove()
+{
+    ThreadPool pool;
+    pool.start(1);
+    assert(!pool.removeGroup(pool.defaultGroup()));
+
+    auto group = pool.createGroup("temp");
+    std::atomic<bool> release{false};
+    std::atomic<int> done{0};
+    auto running = group->submitTask([&]()
+    {
+        while(!release)
+        {
+            std::this_thread::yield();
+        }
+        done++;
+    });
+    auto queued = group->submitTask([&]() { done++; });
+    assert(waitUntil([&]() { return group->stats().running == 1; }));
+
+    assert(pool.removeGroup(group));
+    assert(!pool.removeGroup(group));
+    assert(group->trySubmitTask(nullptr, []() {}).status == SubmitStatus::REJECTED);
+
+    // 调度列表不再持有资源组之后，用户释放最后一个引用时资源组被删除
+    std::weak_ptr<ThreadPool::TaskGroup> weak = group;
+    group.reset();
+    release = true;
+    running.get();
+    queued.get();
+    assert(done == 2);
+    assert(waitUntil([&]() { return weak.expired(); }));
+
+    // 默认资源组不受影响
+    assert(pool.submitTask([]() { return 7; }).get() == 7);
+}
+
+// 资源组最后一个任务执行期间被移除：removeGroup时任务还在执行，任务完成后由工作线程把资源组从调度列表中删除
+static void testRemoveWhileRunning()
+{
+    ThreadPool pool;
+    pool.start(2);
+    auto group = pool.createGroup("temp");
+    std::atomic<bool> release{false};
+    auto running = group->submitTask([&]()
+    {
+        while(!release)
+        {
+            std::this_thread::yield();
+        }
+    });
+    assert(waitUntil([&]() { return group->stats().running == 1; }));
+    assert(pool.removeGroup(group));
+
+    std::weak_ptr<ThreadPool::TaskGroup> weak = group;
+    group.reset();
+    release = true;
+    running.get();
+    assert(waitUntil([&]() { return weak.expired(); }));
+}
+
+// 统计每个资源组执行完成的任务数量的观察者
+class CountingObserver : public TaskObserver
+{
+public:
+    void onTaskDone(const char *group, const char *, std::chrono::nanoseconds, std::chrono::nanoseconds) override
+    {
+        std::unique_lock<std::mutex> lock(mtx);
+        counts[group]++;
+    }
+
+    std::mutex mtx;
+    std::map<std::string, int> counts;
+};
+
+// 观察者在任务的结果交给future之前调用：future就绪后统计中已经包含这个任务，抛出异常的任务也一样
+static void testObserverOrder()
+{
+    ThreadPool pool;
+    pool.start(3);
+    auto observer = std::make_shared<CountingObserver>();
+    pool.setTaskObserver(observer);
+    auto group = pool.createGroup("observed");
+    for(int i = 1; i <= 200; ++i)
+    {
+        if(i % 10 == 0)
+        {
+            auto failed = group->submitTask([]() -> int { throw std::runtime_error("task failed"); });
+            try
+            {
+                failed.get();
+                assert(false);
+            }
+            catch(const std::runtime_error &)
+            {}
+        }
+        else
+        {
+            assert(group->submitTask([i]() { return i; }).get() == i);
+        }
+        std::unique_lock<std::mutex> lock(observer->mtx);
+        assert(observer->counts["observed"] == i);
+    }
+    assert(group->stats().completed == 200);
+}
+
+int main()
+{
+    testMaxConcurrency();
+    testWeights();
+    testRemove();
+    testRemoveWhileRunning();
+    testObserverOrder();
+    std::cout << "group_test passed" << std::endl;
+    return 0;
+}
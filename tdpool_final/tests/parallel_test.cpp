@@ -0,0 +1,217 @@
+#undef NDEBUG // 测试依赖assert
+#include<cassert>
+#include<random>
+#include"parallel.h"
+
+// 并行算法与std::对应算法的结果逐个比较
+// 长度覆盖0、1、小于PARALLEL_MIN_CHUNK（只有一块）、恰好一块、奇数块（归并排序每轮最后一段轮空）和多轮归并；
+// 线程数覆盖1到5，块数上限随线程数变化；另外检查队列满、在工作线程中调用和异常传播
+
+static std::vector<size_t> testSizes()
+{
+    const size_t c = PARALLEL_MIN_CHUNK;
+    return {0, 1, 2, 100, c - 1, c, c + 1, 2 * c, 3 * c + 7, 5 * c + 1, 7 * c + 3, 9 * c, 13 * c + 11, 64 * c + 5};
+}
+
+static std::vector<int> randomInput(size_t n, std::mt19937 &rng)
+{
+    std::vector<int> v(n);
+    for(auto &x : v)
+    {
+        x = (int)(rng() % 1000) - 500; // 大量重复的值，检查归并的切分点
+    }
+    return v;
+}
+
+static void testSort(ThreadPool &pool, const std::vector<int> &input)
+{
+    std::vector<int> a = input, b = input;
+    std::sort(a.begin(), a.end());
+    parallelSort(pool, b.begin(), b.end());
+    assert(a == b);
+
+    a = input;
+    b = input;
+    std::sort(a.begin(), a.end(), std::greater<>());
+    parallelSort(pool, b.begin(), b.end(), std::greater<>());
+    assert(a == b);
+
+    // 只能移动的元素类型
+    std::vector<std::unique_ptr<int>> owned;
+    for(int x : input)
+    {
+        owned.emplace_back(new int(x));
+    }
+    parallelSort(pool, owned.begin(), owned.end(), [](const std::unique_ptr<int> &l, const std::unique_ptr<int> &r) { return *l < *r; });
+    std::sort(a.begin(), a.end());
+    for(size_t i = 0; i < owned.size(); ++i)
+    {
+        assert(owned[i] != nullptr && *owned[i] == a[i]);
+    }
+}
+
+static void testScan(ThreadPool &pool, const std::vector<int> &input)
+{
+    std::vector<long long> wide(input.begin(), input.end());
+    std::vector<long long> a(wide.size()), b(wide.size());
+
+    std::inclusive_scan(wide.begin(), wide.end(), a.begin());
+    assert(parallelInclusiveScan(pool, wide.begin(), wide.end(), b.begin()) == b.end());
+    assert(a == b);
+
+    std::exclusive_scan(wide.begin(), wide.end(), a.begin(), 7LL);
+    assert(parallelExclusiveScan(pool, wide.begin(), wide.end(), b.begin(), 7LL) == b.end());
+    assert(a == b);
+
+    // 非交换的结合运算：块间的前缀必须按顺序合并
+    auto lastNonZero = [](long long l, long long r) { return r != 0 ? r : l; };
+    std::inclusive_scan(wide.begin(), wide.end(), a.begin(), lastNonZero);
+    parallelInclusiveScan(pool, wide.begin(), wide.end(), b.begin(), lastNonZero);
+    assert(a == b);
+
+    // 原地扫描
+    std::inclusive_scan(wide.begin(), wide.end(), a.begin());
+    b = wide;
+    parallelInclusiveScan(pool, b.begin(), b.end(), b.begin());
+    assert(a == b);
+}
+
+static void testTransform(ThreadPool &pool, const std::vector<int> &input)
+{
+    auto square = [](int x) -> long long { return (long long)x * x; };
+    assert(parallelTransformReduce(pool, input.begin(), input.end(), 3LL, std::plus<>(), square)
+           == std::transform_reduce(input.begin(), input.end(), 3LL, std::plus<>(), square));
+
+    std::vector<long long> a(input.size()), b(input.size());
+    std::transform(input.begin(), input.end(), a.begin(), square);
+    assert(parallelTransform(pool, input.begin(), input.end(), b.begin(), square) == b.end());
+    assert(a == b);
+
+    // 每个下标恰好被处理一次
+    std::vector<std::atomic<int>> visits(input.size());
+    parallelForRange(pool, input.begin(), input.end(), [&](size_t begin, size_t end)
+    {
+        assert(begin <= end && end <= input.size());
+        for(size_t i = begin; i < end; ++i)
+        {
+            visits[i]++;
+        }
+    });
+    for(auto &visit : visits)
+    {
+        assert(visit == 1);
+    }
+}
+
+static void testFind(ThreadPool &pool, const std::vector<int> &input, std::mt19937 &rng)
+{
+    auto isBig = [](int x) { return x >= 490; };
+    assert(parallelFindIf(pool, input.begin(), input.end(), isBig) == std::find_if(input.begin(), input.end(), isBig));
+    auto never = [](int) { return false; };
+    assert(parallelFindIf(pool, input.begin(), input.end(), never) == input.end());
+
+    // 多个满足条件的元素时返回第一个
+    if(!input.empty())
+    {
+        std::vector<int> v = input;
+        for(int i = 0; i < 3; ++i)
+        {
+            v[rng() % v.size()] = 10000;
+        }
+        auto isTarget = [](int x) { return x == 10000; };
+        assert(parallelFindIf(pool, v.begin(), v.end(), isTarget) == std::find_if(v.begin(), v.end(), isTarget));
+    }
+}
+
+static void testPartition(ThreadPool &pool, const std::vector<int> &input)
+{
+    std::vector<int> a = input, b = input;
+    auto isEven = [](int x) { return x % 2 == 0; };
+    auto pa = std::stable_partition(a.begin(), a.end(), isEven);
+    auto pb = parallelStablePartition(pool, b.begin(), b.end(), isEven);
+    assert(pa - a.begin() == pb - b.begin());
+    assert(a == b);
+}
+
+static void testAll(ThreadPool &pool, std::mt19937 &rng)
+{
+    for(size_t n : testSizes())
+    {
+        std::vector<int> input = randomInput(n, rng);
+        testSort(pool, input);
+        testScan(pool, input);
+        testTransform(pool, input);
+        testFind(pool, input, rng);
+        testPartition(pool, input);
+    }
+}
+
+int main()
+{
+    std::mt19937 rng(12345);
+    for(int threads = 1; threads <= 5; ++threads)
+    {
+        ThreadPool pool;
+        pool.start(threads);
+        testAll(pool, rng);
+    }
+
+    // 队列只能放一个任务：辅助任务提交失败时调用线程把剩下的块做完
+    {
+        ThreadPool pool;
+        pool.setTaskQueMaxThreshHold(1);
+        pool.start(3);
+        testAll(pool, rng);
+    }
+
+    // 在工作线程中调用，所有工作线程都在等待时也不会死锁
+    {
+        ThreadPool pool;
+        pool.start(2);
+        std::vector<std::future<bool>> results;
+        for(int i = 0; i < 4; ++i)
+        {
+            results.emplace_back(pool.submitTask([&pool, i]()
+            {
+                std::mt19937 local(i);
+                std::vector<int> v = randomInput(9 * PARALLEL_MIN_CHUNK, local);
+                std::vector<int> expected = v;
+                std::sort(expected.begin(), expected.end());
+                parallelSort(pool, v.begin(), v.end());
+                return v == expected;
+            }));
+        }
+        for(auto &result : results)
+        {
+            assert(result.get());
+        }
+    }
+
+    // 块中抛出的异常在调用线程重新抛出，其余的块仍然执行完
+    {
+        ThreadPool pool;
+        pool.start(4);
+        std::atomic<int> ran{0};
+        bool thrown = false;
+        try
+        {
+            parallelChunks(pool, 16, [&](size_t chunk)
+            {
+                ran++;
+                if(chunk == 5)
+                {
+                    throw std::runtime_error("chunk failed");
+                }
+            });
+        }
+        catch(const std::runtime_error &)
+        {
+            thrown = true;
+        }
+        assert(thrown);
+        assert(ran == 16);
+    }
+
+    std::cout << "parallel_test passed" << std::endl;
+    return 0;
+}
@@ -0,0 +1,240 @@
+#undef NDEBUG // 测试依赖assert
+#include<cassert>
+#include<fcntl.h>
+#include<sys/socket.h>
+#include"threadpool.h"
+
+// 反应器的fd回调：pipe、eventfd、socketpair三种fd，检查数据不丢、同一个fd的回调不并发、modifyFd和removeFd；
+// 以及反应器开启时普通任务和绑定槽位的任务都能执行
+
+// 等待条件成立，超时返回false
+template<typename Pred>
+static bool waitUntil(Pred pred, std::chrono::milliseconds timeout = std::chrono::seconds(5))
+{
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    while(!pred())
+    {
+        if(std::chrono::steady_clock::now() > deadline)
+        {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+}
+
+// 回调共享的状态，回调持有shared_ptr：removeFd返回时已经开始的回调可能还在执行
+// 记录同一个fd的回调的最大并发数
+struct ConcurrencyProbe
+{
+    void enter()
+    {
+        int now = ++inside;
+        int seen = maxInside.load();
+        while(now > seen && !maxInside.compare_exchange_weak(seen, now))
+        {}
+    }
+
+    void leave()
+    {
+        --inside;
+    }
+
+    std::atomic<int> inside{0};
+    std::atomic<int> maxInside{0};
+    std::atomic<uint64_t> count{0}; // 收到的字节数、计数或者请求数
+    std::atomic<int> calls{0};
+};
+
+// pipe：读端可读时读出所有数据，写端分批写入，读到的字节数必须一致
+static void testPipe(ThreadPool &pool)
+{
+    int fds[2];
+    assert(::pipe2(fds, O_NONBLOCK) == 0);
+
+    auto probe = std::make_shared<ConcurrencyProbe>();
+    int rfd = fds[0];
+    assert(pool.addFd(rfd, EPOLLIN, [probe, rfd](uint32_t events)
+    {
+        probe->enter();
+        assert(events & EPOLLIN);
+        char buf[256];
+        ssize_t n;
+        while((n = ::read(rfd, buf, sizeof(buf))) > 0)
+        {
+            probe->count += n;
+        }
+        probe->leave();
+    }));
+    assert(!pool.addFd(fds[0], EPOLLIN, [](uint32_t) {})); // 重复注册
+
+    const size_t total = 64 * 1000;
+    char chunk[64] = {};
+    for(size_t sent = 0; sent < total; sent += sizeof(chunk))
+    {
+        while(::write(fds[1], chunk, sizeof(chunk)) < 0)
+        {
+            std::this_thread::yield();
+        }
+    }
+    assert(waitUntil([&]() { return probe->count == total; }));
+    assert(probe->maxInside == 1);
+
+    assert(pool.removeFd(fds[0]));
+    assert(!pool.removeFd(fds[0]));
+    ::close(fds[0]);
+    ::close(fds[1]);
+}
+
+// eventfd：多个线程并发累加，回调读出计数，总和必须一致；回调中故意停留一段时间，检查同一个fd的回调不会并发
+static void testEventfd(ThreadPool &pool)
+{
+    int efd = ::eventfd(0, EFD_NONBLOCK);
+    assert(efd >= 0);
+
+    auto probe = std::make_shared<ConcurrencyProbe>();
+    assert(pool.addFd(efd, EPOLLIN, [probe, efd](uint32_t)
+    {
+        probe->enter();
+        uint64_t cnt;
+        if(::read(efd, &cnt, sizeof(cnt)) == sizeof(cnt))
+        {
+            probe->count += cnt;
+        }
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+        probe->leave();
+    }));
+
+    const int writers = 4;
+    const int perWriter = 500;
+    std::vector<std::thread> threads;
+    for(int i = 0; i < writers; ++i)
+    {
+        threads.emplace_back([&]()
+        {
+            for(int j = 0; j < perWriter; ++j)
+            {
+                uint64_t one = 1;
+                ssize_t n = ::write(efd, &one, sizeof(one));
+                assert(n == sizeof(one));
+                (void)n;
+            }
+        });
+    }
+    for(auto &thread : threads)
+    {
+        thread.join();
+    }
+    assert(waitUntil([&]() { return probe->count == (uint64_t)writers * perWriter; }));
+    assert(probe->maxInside == 1);
+
+    assert(pool.removeFd(efd));
+    ::close(efd);
+}
+
+// socketpair：收到请求后在回调中用modifyFd切换到EPOLLOUT，可写时回复再切回EPOLLIN
+// socket几乎总是可写的，如果modifyFd在回调中立即重新监听，其他线程会在这个回调返回前执行下一次回调
+static void testSocketpairModify(ThreadPool &pool)
+{
+    int sv[2];
+    assert(::socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, sv) == 0);
+    int server = sv[0];
+    int client = sv[1];
+    int flags = ::fcntl(client, F_GETFL);
+    ::fcntl(client, F_SETFL, flags & ~O_NONBLOCK);
+
+    // count为收到还没回复的请求数量
+    auto probe = std::make_shared<ConcurrencyProbe>();
+    assert(pool.addFd(server, EPOLLIN, [probe, server, &pool](uint32_t events)
+    {
+        probe->enter();
+        probe->calls++;
+        if(events & EPOLLIN)
+        {
+            char c;
+            while(::read(server, &c, 1) == 1)
+            {
+                probe->count++;
+            }
+            pool.modifyFd(server, EPOLLOUT);
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        }
+        else if(events & EPOLLOUT)
+        {
+            for(; probe->count > 0; probe->count--)
+            {
+                ssize_t n = ::write(server, "r", 1);
+                assert(n == 1);
+                (void)n;
+            }
+            pool.modifyFd(server, EPOLLIN);
+        }
+        probe->leave();
+    }));
+
+    for(int i = 0; i < 100; ++i)
+    {
+        char c = 'q';
+        assert(::write(client, &c, 1) == 1);
+        assert(::read(client, &c, 1) == 1 && c == 'r');
+    }
+    assert(probe->maxInside == 1);
+
+    // 修改不存在的fd
+    assert(!pool.modifyFd(-1, EPOLLIN));
+
+    // 取消注册后不再调用回调，先等最后一次回调返回
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    assert(pool.removeFd(server));
+    int before = probe->calls;
+    char c = 'q';
+    assert(::write(client, &c, 1) == 1);
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    assert(probe->calls == before);
+
+    ::close(server);
+    ::close(client);
+}
+
+int main()
+{
+    {
+        // 开启反应器前不能注册fd
+        ThreadPool pool;
+        assert(!pool.addFd(0, EPOLLIN, [](uint32_t) {}));
+    }
+
+    ThreadPool pool;
+    pool.start(4);
+    assert(pool.enableReactor());
+    assert(pool.enableReactor());
+
+    testPipe(pool);
+    testEventfd(pool);
+    testSocketpairModify(pool);
+
+    // 反应器开启时普通任务仍然正常执行
+    std::vector<std::future<int>> results;
+    for(int i = 0; i < 100; ++i)
+    {
+        results.emplace_back(pool.submitTask([](int x) { return x * 2; }, i));
+    }
+    for(int i = 0; i < 100; ++i)
+    {
+        assert(results[i].get() == i * 2);
+    }
+
+    // 绑定到每个槽位的任务都能执行，包括正在epoll_wait的leader线程的槽位（其他线程不会取这个槽位的任务）
+    for(int round = 0; round < 20; ++round)
+    {
+        for(size_t slot = 0; slot < 4; ++slot)
+        {
+            auto result = pool.submitTask(Affinity::worker(slot), [](int x) { return x; }, (int)slot);
+            assert(result.wait_for(std::chrono::seconds(5)) == std::future_status::ready);
+            assert(result.get() == (int)slot);
+        }
+    }
+
+    std::cout << "reactor_test passed" << std::endl;
+    return 0;
+}
@@ -0,0 +1,504 @@
+#undef NDEBUG // 测试依赖assert
+#include<cassert>
+#include<random>
+#include<sys/eventfd.h>
+#include"admission.h"
+#include"strand.h"
+
+// 随机交错的压力测试：每一轮并发启动几个线程池，多个提交线程随机地阻塞提交、非阻塞提交、按资源组和亲和性提交、
+// 提交到strand、记忆化提交、丢弃future、在阻塞区域中等待提交到自己槽位的任务、访问WorkerLocal、触发反应器的fd回调，
+// 控制线程同时随机resize、调整队列容量、创建和移除资源组、添加准入策略、注册和注销钩子，然后在任务还在排队时销毁线程池；
+// 有的轮次加入空闲1秒就回收线程的cached线程池，提交停止后继续稀疏地提交任务，让空闲回收和退出钩子与任务交错
+// 任务和操作之间随机让出CPU或者短暂睡眠，打乱线程的调度顺序；配合make stress-tsan / stress-asan检查数据竞争和内存错误
+// 用法：stress [秒数] [随机种子]，失败时打印种子，用同一个种子可以重放同一组随机选择（线程交错仍然不确定）
+
+static uint64_t seed;
+
+// 每个线程独立的随机数，种子由全局种子和线程序号决定
+static std::mt19937_64 &rng()
+{
+    static std::atomic<uint64_t> threadIndex{0};
+    thread_local std::mt19937_64 engine(seed * 1000003 + threadIndex++);
+    return engine;
+}
+
+static size_t randomBelow(size_t n)
+{
+    return std::uniform_int_distribution<size_t>(0, n - 1)(rng());
+}
+
+// 调度扰动：大部分时候什么都不做，偶尔让出CPU或者睡几十微秒
+static void fuzz()
+{
+    size_t r = randomBelow(100);
+    if(r < 10)
+    {
+        std::this_thread::yield();
+    }
+    else if(r < 12)
+    {
+        std::this_thread::sleep_for(std::chrono::microseconds(randomBelow(50)));
+    }
+}
+
+// 一轮的统计：被接受的任务必须恰好执行一次，线程池销毁时全部执行完；工作线程的启动和退出钩子成对执行，
+// WorkerLocal的对象在线程退出或者WorkerLocal析构时全部销毁
+struct Counters
+{
+    std::atomic<uint64_t> executed{0};
+    std::atomic<uint64_t> accepted{0};
+    std::atomic<int> workersStarted{0};
+    std::atomic<int> workersStopped{0};
+    std::atomic<int> localsAlive{0};
+};
+
+// 空闲1秒就回收多余线程的配置
+struct ShortIdleConfig : DefaultPoolConfig
+{
+    static constexpr int THREAD_IDLE_TIME = 1;
+};
+
+using ShortIdlePool = BasicThreadPool<DequeQueuePolicy, BlockingWaitPolicy, std::function<void()>, std::allocator<char>, ShortIdleConfig>;
+
+// 每个工作线程一份的计数器，记录存活的对象数量
+struct LocalCounter
+{
+    explicit LocalCounter(std::atomic<int> &alive)
+        : alive(alive)
+    {
+        alive++;
+    }
+
+    ~LocalCounter()
+    {
+        alive--;
+    }
+
+    std::atomic<int> &alive;
+    std::atomic<uint64_t> value{0}; // 控制线程会在任务执行期间遍历读取
+};
+
+// 反应器回调共享的eventfd：提交线程写入计数，回调读出并计入executed；最后一个回调返回后才关闭fd
+struct ReactorProbe
+{
+    ReactorProbe()
+        : fd(::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC))
+    {}
+
+    ~ReactorProbe()
+    {
+        ::close(fd);
+    }
+
+    int fd;
+    std::atomic<uint64_t> written{0};
+    std::atomic<uint64_t> consumed{0};
+};
+
+// 启动前注册钩子，之后创建的每个工作线程（包括补偿线程和cached模式新建的线程）都会成对调用
+template<typename Pool>
+static void watchWorkers(Pool &pool, Counters &counters)
+{
+    pool.onWorkerStart([&counters](int) { counters.workersStarted++; fuzz(); });
+    pool.onWorkerStop([&counters](int) { fuzz(); counters.workersStopped++; });
+}
+
+// 单个线程池上的一轮随机操作，Pool为ThreadPool或者其他策略组合
+// quiet为true时，提交线程停止后再稀疏地提交一段时间，让cached模式多出来的线程空闲回收
+template<typename Pool>
+static void runPool(Pool &pool, Counters &counters, std::chrono::milliseconds duration, std::shared_ptr<Strand> strand, bool quiet = false)
+{
+    std::atomic<bool> stop{false};
+    std::atomic<int> cappedRunning{0}; // 并发上限为2的资源组中正在执行的任务数量
+    std::mutex groupsMtx;
+    std::vector<std::shared_ptr<typename Pool::TaskGroup>> groups;
+    groups.emplace_back(pool.createGroup("capped", 1, 2));
+    groups.emplace_back(pool.createGroup("heavy", 4));
+
+    auto task = [&counters]() -> int
+    {
+        fuzz();
+        counters.executed++;
+        return 1;
+    };
+
+    // strand中的任务按提交顺序串行执行，不加锁的计数器被并发访问时TSan会报告
+    auto strandOrder = std::make_shared<std::pair<uint64_t, uint64_t>>(0, 0);
+
+    // 访问WorkerLocal的任务都保留future，在local析构之前收掉
+    WorkerLocal<LocalCounter, Pool> local(pool, [&counters]() { return std::make_unique<LocalCounter>(counters.localsAlive); });
+    auto localTask = [&counters, &local]() -> int
+    {
+        local->value++;
+        fuzz();
+        counters.executed++;
+        return 1;
+    };
+
+    // 一半的轮次开启反应器
+    std::shared_ptr<ReactorProbe> probe;
+    if(randomBelow(2) == 0 && pool.enableReactor())
+    {
+        probe = std::make_shared<ReactorProbe>();
+        assert(probe->fd >= 0);
+        assert(pool.addFd(probe->fd, EPOLLIN, [&counters, probe](uint32_t)
+        {
+            uint64_t value;
+            if(::read(probe->fd, &value, sizeof(value)) == sizeof(value))
+            {
+                fuzz();
+                counters.executed += value;
+                probe->consumed += value;
+            }
+        }));
+    }
+    std::atomic<int> policies{0};
+
+    auto submitter = [&]()
+    {
+        std::vector<std::future<int>> futures;
+        while(!stop)
+        {
+            switch(randomBelow(12))
+            {
+            case 0:
+                futures.emplace_back(pool.submitTask(task));
+                break;
+            case 1:
+            {
+                auto result = pool.trySubmitTask(nullptr, task);
+                if(result.status == SubmitStatus::OK)
+                {
+                    futures.emplace_back(std::move(result.future));
+                }
+                break;
+            }
+            case 2:
+                // 丢弃future，共享状态由任务单独持有
+                if(pool.trySubmitTask(nullptr, task).status == SubmitStatus::OK)
+                {
+                    counters.accepted++;
+                }
+                break;
+            case 3:
+                futures.emplace_back(pool.submitTask(Affinity::key(randomBelow(16)), task));
+                break;
+            case 4:
+            {
+                std::shared_ptr<typename Pool::TaskGroup> group;
+                {
+                    std::unique_lock<std::mutex> lock(groupsMtx);
+                    group = groups[randomBelow(groups.size())];
+                }
+                // capped组的并发上限为2；这些任务的future都会在runPool返回前收掉，可以引用局部变量
+                std::atomic<int> *running = group->name() == "capped" ? &cappedRunning : nullptr;
+                auto result = group->trySubmitTask(nullptr, [&counters, running]() -> int
+                {
+                    if(running != nullptr)
+                    {
+                        assert(++*running <= 2);
+                    }
+                    fuzz();
+                    if(running != nullptr)
+                    {
+                        --*running;
+                    }
+                    counters.executed++;
+                    return 1;
+                });
+                if(result.status == SubmitStatus::OK)
+                {
+                    futures.emplace_back(std::move(result.future));
+                }
+                break;
+            }
+            case 5:
+                if(strand != nullptr)
+                {
+                    futures.emplace_back(strand->submitTask([&counters, strandOrder]() -> int
+                    {
+                        strandOrder->first++;
+                        fuzz();
+                        strandOrder->second++;
+                        assert(strandOrder->first == strandOrder->second);
+                        counters.executed++;
+                        return 1;
+                    }));
+                }
+                break;
+            case 6:
+            {
+                // 记忆化的任务可能命中缓存而不执行，不计入executed
+                int key = (int)randomBelow(64);
+                try
+                {
+                    assert(pool.submitMemoized(key, [](int x) -> int { fuzz(); return x; }, key).get() == key);
+                }
+                catch(const std::future_error &)
+                {
+                    // 被准入策略拒绝或者队列满提交失败时，计算任务随提交一起销毁，共享结果得到broken_promise
+                }
+                break;
+            }
+            case 7:
+                futures.emplace_back(pool.submitTask(localTask));
+                break;
+            case 8:
+                // 在阻塞区域中等待提交到自己槽位的任务：槽位的线程忙，由其他线程或者补偿线程窃取
+                // 线程数达到上限时补偿线程可能建不出来，只等一小段时间，没等到的任务由线程池析构时执行完
+                futures.emplace_back(pool.submitTask([&pool, &counters]() -> int
+                {
+                    typename Pool::BlockingRegion region;
+                    auto child = pool.submitTask(Affinity::worker(pool.currentWorkerSlot()), [&counters]() -> int
+                    {
+                        fuzz();
+                        counters.executed++;
+                        return 1;
+                    });
+                    if(child.wait_for(std::chrono::milliseconds(20)) == std::future_status::ready)
+                    {
+                        counters.accepted += child.get();
+                    }
+                    else
+                    {
+                        counters.accepted++;
+                    }
+                    counters.executed++;
+                    return 1;
+                }));
+                break;
+            case 9:
+                if(probe != nullptr)
+                {
+                    uint64_t one = 1;
+                    if(::write(probe->fd, &one, sizeof(one)) == sizeof(one))
+                    {
+                        probe->written++;
+                        counters.accepted++;
+                    }
+                }
+                break;
+            default:
+                fuzz();
+                break;
+            }
+            // 定期收掉已经完成的future，避免占用太多内存
+            if(futures.size() > 256)
+            {
+                for(auto &future : futures)
+                {
+                    counters.accepted += future.get();
+                }
+                futures.clear();
+            }
+        }
+        // 等剩下的任务执行完
+        for(auto &future : futures)
+        {
+            counters.accepted += future.get();
+        }
+    };
+
+    // 控制线程：随机调整线程数量、队列容量和记忆化缓存容量，创建和移除资源组
+    auto controller = [&]()
+    {
+        while(!stop)
+        {
+            switch(randomBelow(8))
+            {
+            case 0:
+                pool.resize((int)randomBelow(6) + 1);
+                break;
+            case 1:
+                pool.setQueueCapacity(randomBelow(64) + 1);
+                break;
+            case 2:
+            {
+                auto group = pool.createGroup("temp", (unsigned)randomBelow(4) + 1, randomBelow(3));
+                std::unique_lock<std::mutex> lock(groupsMtx);
+                groups.emplace_back(group);
+                break;
+            }
+            case 3:
+            {
+                std::unique_lock<std::mutex> lock(groupsMtx);
+                if(groups.size() > 2)
+                {
+                    size_t i = 2 + randomBelow(groups.size() - 2);
+                    pool.removeGroup(groups[i]);
+                    groups.erase(groups.begin() + i);
+                }
+                break;
+            }
+            case 4:
+                pool.setMemoCapacity(randomBelow(256));
+                break;
+            case 5:
+                // 宽松的准入策略，负载高时才会拒绝；策略只能添加，每个线程池最多两个
+                if(policies < 2)
+                {
+                    switch(randomBelow(3))
+                    {
+                    case 0:
+                        pool.addAdmissionPolicy(std::make_shared<TokenBucketPolicy>(200000, 1024));
+                        break;
+                    case 1:
+                        pool.addAdmissionPolicy(std::make_shared<AimdConcurrencyPolicy>(256, 16, 1024, std::chrono::milliseconds(50)));
+                        break;
+                    default:
+                        pool.addAdmissionPolicy(std::make_shared<CoDelPolicy>(std::chrono::milliseconds(20), std::chrono::milliseconds(100)));
+                        break;
+                    }
+                    policies++;
+                }
+                break;
+            case 6:
+                // 工作线程退出时可能正在执行钩子的拷贝
+                pool.removeWorkerHook(pool.onWorkerStop([](int) { fuzz(); }));
+                break;
+            case 7:
+            {
+                // 与线程退出时销毁对象并发遍历
+                uint64_t total = 0;
+                local.forEach([&total](int, LocalCounter &counter) { total += counter.value; });
+                (void)total;
+                break;
+            }
+            }
+            std::this_thread::sleep_for(std::chrono::microseconds(randomBelow(2000)));
+        }
+    };
+
+    std::vector<std::thread> threads;
+    size_t submitters = randomBelow(4) + 1;
+    for(size_t i = 0; i < submitters; ++i)
+    {
+        threads.emplace_back(submitter);
+    }
+    threads.emplace_back(controller);
+    std::this_thread::sleep_for(duration);
+    stop = true;
+    for(auto &thread : threads)
+    {
+        thread.join();
+    }
+
+    // 稀疏地提交访问WorkerLocal的任务，多出来的线程陆续空闲回收，退出钩子和任务交错执行
+    if(quiet)
+    {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(1500);
+        while(std::chrono::steady_clock::now() < deadline)
+        {
+            counters.accepted += pool.submitTask(localTask).get();
+            std::this_thread::sleep_for(std::chrono::milliseconds(randomBelow(50)));
+        }
+    }
+
+    // 写入eventfd的计数全部被回调读出后才注销
+    if(probe != nullptr)
+    {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+        while(probe->consumed != probe->written)
+        {
+            assert(std::chrono::steady_clock::now() < deadline);
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        assert(pool.removeFd(probe->fd));
+    }
+}
+
+// 一轮：几个线程池在不同线程上并发启动和运行，结束后按随机顺序销毁
+static void runRound(std::chrono::milliseconds duration)
+{
+    Counters counters;
+    {
+        std::vector<std::unique_ptr<ThreadPool>> pools;
+        size_t poolCount = randomBelow(3) + 1;
+        for(size_t i = 0; i < poolCount; ++i)
+        {
+            pools.emplace_back(new ThreadPool());
+            if(randomBelow(2) == 0)
+            {
+                pools.back()->setMode(PoolMode::MODE_CACHED);
+                pools.back()->setThreadSizeThreshHold(8);
+            }
+            pools.back()->setTaskQueMaxThreshHold((int)randomBelow(128) + 1);
+            watchWorkers(*pools.back(), counters);
+        }
+
+        std::vector<std::thread> runners;
+        for(auto &pool : pools)
+        {
+            ThreadPool *p = pool.get();
+            runners.emplace_back([p, &counters, duration]()
+            {
+                // 启动前resize被拒绝，启动后立即resize
+                assert(!p->resize(2));
+                p->start((int)randomBelow(4) + 1);
+                if(randomBelow(2) == 0)
+                {
+                    assert(p->resize((int)randomBelow(4) + 1));
+                }
+                auto strand = std::make_shared<Strand>(*p);
+                runPool(*p, counters, duration, strand);
+            });
+        }
+
+        // 三分之一的轮次加入空闲1秒就回收线程的cached线程池，常驻线程少，突发的任务会创建多余的线程
+        std::unique_ptr<ShortIdlePool> shortIdle;
+        if(randomBelow(3) == 0)
+        {
+            shortIdle.reset(new ShortIdlePool());
+            shortIdle->setMode(PoolMode::MODE_CACHED);
+            assert(shortIdle->setThreadSizeThreshHold(8));
+            watchWorkers(*shortIdle, counters);
+            ShortIdlePool *p = shortIdle.get();
+            runners.emplace_back([p, &counters, duration]()
+            {
+                p->start((int)randomBelow(2) + 1);
+                runPool(*p, counters, duration, nullptr, true);
+            });
+        }
+
+        // 非默认策略的线程池：环形队列 + 忙等 + 无堆分配的任务对象
+        BasicThreadPool<RingQueuePolicy, SpinWaitPolicy, InplaceTask<64>> fast;
+        watchWorkers(fast, counters);
+        fast.start((int)randomBelow(3) + 1);
+        runPool(fast, counters, duration, nullptr);
+
+        for(auto &runner : runners)
+        {
+            runner.join();
+        }
+        shortIdle.reset();
+
+        // 随机顺序销毁，析构时还可能有任务在排队
+        std::shuffle(pools.begin(), pools.end(), rng());
+        while(!pools.empty())
+        {
+            pools.pop_back();
+            fuzz();
+        }
+    }
+    assert(counters.executed == counters.accepted);
+    assert(counters.workersStarted == counters.workersStopped);
+    assert(counters.localsAlive == 0);
+}
+
+int main(int argc, char **argv)
+{
+    int seconds = argc > 1 ? std::atoi(argv[1]) : 10;
+    seed = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : std::random_device()();
+    std::cout << "stress: " << seconds << "s, seed " << seed << std::endl;
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(seconds);
+    int rounds = 0;
+    do
+    {
+        runRound(std::chrono::milliseconds(randomBelow(200) + 20));
+        rounds++;
+    } while(std::chrono::steady_clock::now() < deadline);
+
+    std::cout << "stress passed: " << rounds << " rounds, seed " << seed << std::endl;
+    return 0;
+}
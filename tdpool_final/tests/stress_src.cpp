@@ -0,0 +1,120 @@
+#undef NDEBUG // 测试依赖assert
+#include<cassert>
+#include<iostream>
+#include<random>
+#include"threadpool.h"
+
+// src/下Any + Result版本线程池的压力测试：多个线程池在不同线程上并发创建、启动、提交和销毁，
+// 随机丢弃Result（Result先于任务析构），提交后立即销毁线程池（析构时工作线程可能正在检查状态）
+// 用法：stress_src [秒数] [随机种子]
+
+static uint64_t seed;
+
+static std::mt19937_64 &rng()
+{
+    static std::atomic<uint64_t> threadIndex{0};
+    thread_local std::mt19937_64 engine(seed * 1000003 + threadIndex++);
+    return engine;
+}
+
+static size_t randomBelow(size_t n)
+{
+    return std::uniform_int_distribution<size_t>(0, n - 1)(rng());
+}
+
+static void fuzz()
+{
+    size_t r = randomBelow(100);
+    if(r < 10)
+    {
+        std::this_thread::yield();
+    }
+    else if(r < 12)
+    {
+        std::this_thread::sleep_for(std::chrono::microseconds(randomBelow(50)));
+    }
+}
+
+class CountTask : public Task
+{
+public:
+    explicit CountTask(std::atomic<uint64_t> &executed)
+        : executed_(executed)
+    {}
+
+    Any run()
+    {
+        fuzz();
+        executed_++;
+        return 1;
+    }
+
+private:
+    std::atomic<uint64_t> &executed_;
+};
+
+// 一个线程池的完整生命周期，队列不设上限，提交的任务在析构前全部执行完
+static void poolLifetime(std::atomic<uint64_t> &executed, std::atomic<uint64_t> &submitted)
+{
+    ThreadPool pool;
+    if(randomBelow(2) == 0)
+    {
+        pool.setMode(PoolMode::MODE_CACHED);
+        pool.setThreadSizeThreshHold(8);
+    }
+    pool.start((int)randomBelow(4) + 1);
+
+    std::vector<std::unique_ptr<Result>> results; // Result不能拷贝和移动
+    size_t tasks = randomBelow(200);
+    for(size_t i = 0; i < tasks; ++i)
+    {
+        if(randomBelow(2) == 0)
+        {
+            results.emplace_back(new Result(pool.submitTask(std::make_shared<CountTask>(executed))));
+        }
+        else
+        {
+            pool.submitTask(std::make_shared<CountTask>(executed));
+        }
+        submitted++;
+        fuzz();
+    }
+    // 只取一部分结果，其余的Result和线程池一起析构
+    for(size_t i = 0; i < results.size() / 2; ++i)
+    {
+        assert(results[i]->get().cast_<int>() == 1);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int seconds = argc > 1 ? std::atoi(argv[1]) : 10;
+    seed = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : std::random_device()();
+    std::cout << "stress_src: " << seconds << "s, seed " << seed << std::endl;
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(seconds);
+    int rounds = 0;
+    do
+    {
+        std::atomic<uint64_t> executed{0};
+        std::atomic<uint64_t> submitted{0};
+        std::vector<std::thread> threads;
+        size_t pools = randomBelow(4) + 1;
+        for(size_t i = 0; i < pools; ++i)
+        {
+            threads.emplace_back([&]()
+            {
+                poolLifetime(executed, submitted);
+            });
+        }
+        for(auto &thread : threads)
+        {
+            thread.join();
+        }
+        assert(executed == submitted);
+        rounds++;
+    } while(std::chrono::steady_clock::now() < deadline);
+
+    std::cout << "stress_src passed: " << rounds << " rounds, seed " << seed << std::endl;
+    return 0;
+}
@@ -0,0 +1,246 @@
+#undef NDEBUG // 测试依赖assert
+#include<cassert>
+#include"threadpool.h"
+
+// 工作线程的生命周期：cached模式空闲回收的线程数量、运行时修改线程和队列阈值、启动和退出钩子的顺序，WorkerLocal的惰性构造、归约和随线程退出销毁
+
+// 等待条件成立，超时返回false
+template<typename Pred>
+static bool waitUntil(Pred pred, std::chrono::milliseconds timeout = std::chrono::seconds(5))
+{
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    while(!pred())
+    {
+        if(std::chrono::steady_clock::now() > deadline)
+        {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+}
+
+// 空闲1秒就回收多余线程的配置
+struct ShortIdleConfig : DefaultPoolConfig
+{
+    static constexpr int THREAD_IDLE_TIME = 1;
+};
+
+using ShortIdlePool = BasicThreadPool<DequeQueuePolicy, BlockingWaitPolicy, std::function<void()>, std::allocator<char>, ShortIdleConfig>;
+
+// cached模式突发任务创建的多余线程空闲后回收到初始数量，不会多回收；退出钩子执行得慢时多个线程同时判断回收也一样
+static void testIdleReclaim(std::chrono::milliseconds hookDelay)
+{
+    ShortIdlePool pool;
+    pool.setMode(PoolMode::MODE_CACHED);
+    pool.setThreadSizeThreshHold(8);
+    std::atomic<int> stopped{0};
+    pool.onWorkerStop([&stopped, hookDelay](int)
+    {
+        std::this_thread::sleep_for(hookDelay);
+        stopped++;
+    });
+    pool.start(2);
+
+    std::vector<std::future<void>> results;
+    for(int i = 0; i < 40; ++i)
+    {
+        results.emplace_back(pool.submitTask([]() { std::this_thread::sleep_for(std::chrono::milliseconds(20)); }));
+    }
+    for(auto &result : results)
+    {
+        result.get();
+    }
+    int grown = pool.getThreadSize();
+    assert(grown > 2);
+
+    assert(waitUntil([&]() { return stopped == grown - 2; }, std::chrono::seconds(10)));
+    // 再等过几轮空闲检查，常驻线程不会被回收
+    std::this_thread::sleep_for(std::chrono::milliseconds(2500));
+    assert(pool.getThreadSize() == 2);
+    assert(stopped == grown - 2);
+    assert(pool.submitTask([]() { return 1; }).get() == 1);
+}
+
+// 运行时修改阈值：cached模式的线程上限立即限制增长，不能小于常驻线程数量，fixed模式拒绝；队列上限立即生效
+static void testThresholdLive()
+{
+    ThreadPool fixed;
+    fixed.start(1);
+    assert(!fixed.setThreadSizeThreshHold(8));
+
+    ThreadPool pool;
+    pool.setMode(PoolMode::MODE_CACHED);
+    pool.start(2);
+    assert(!pool.setThreadSizeThreshHold(1));
+    assert(pool.setThreadSizeThreshHold(3));
+
+    std::atomic<int> maxThreads{0};
+    std::vector<std::future<void>> results;
+    for(int i = 0; i < 30; ++i)
+    {
+        results.emplace_back(pool.submitTask([&]()
+        {
+            int now = pool.getThreadSize();
+            int seen = maxThreads.load();
+            while(now > seen && !maxThreads.compare_exchange_weak(seen, now))
+            {}
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }));
+    }
+    for(auto &result : results)
+    {
+        result.get();
+    }
+    assert(maxThreads == 3);
+    assert(pool.getThreadSize() <= 3);
+
+    // 工作线程被占住时，队列上限1只能再放一个任务
+    ThreadPool single;
+    single.start(1);
+    std::promise<void> release;
+    std::shared_future<void> released = release.get_future().share();
+    std::promise<void> started;
+    auto blocker = single.submitTask([&started, released]() { started.set_value(); released.wait(); });
+    started.get_future().wait();
+    single.setTaskQueMaxThreshHold(1);
+    assert(single.trySubmitTask(nullptr, []() {}).status == SubmitStatus::OK);
+    assert(single.trySubmitTask(nullptr, []() {}).status == SubmitStatus::QUEUE_FULL);
+    release.set_value();
+    blocker.get();
+}
+
+// 每个工作线程一份的计数器，记录构造和析构的次数
+struct Counter
+{
+    explicit Counter(std::atomic<int> &alive)
+        : alive(alive)
+        , value(0)
+    {
+        alive++;
+    }
+
+    ~Counter()
+    {
+        alive--;
+    }
+
+    std::atomic<int> &alive;
+    uint64_t value;
+};
+
+// 惰性构造：只有访问过的工作线程才有对象；forEach归约所有线程的计数；线程池外访问抛出异常
+static void testWorkerLocal()
+{
+    ThreadPool pool;
+    pool.start(4);
+    std::atomic<int> alive{0};
+    std::atomic<int> constructed{0};
+    {
+        WorkerLocal<Counter> local(pool, [&]()
+        {
+            constructed++;
+            return std::make_unique<Counter>(alive);
+        });
+        assert(local.size() == 0);
+
+        bool thrown = false;
+        try
+        {
+            local.get();
+        }
+        catch(const std::runtime_error &)
+        {
+            thrown = true;
+        }
+        assert(thrown);
+
+        std::vector<std::future<void>> results;
+        for(int i = 0; i < 1000; ++i)
+        {
+            results.emplace_back(pool.submitTask([&local]() { local->value++; }));
+        }
+        for(auto &result : results)
+        {
+            result.get();
+        }
+        assert(local.size() >= 1 && local.size() <= 4);
+        assert(constructed == (int)local.size());
+        assert(alive == constructed);
+
+        uint64_t total = 0;
+        local.forEach([&](int, Counter &counter) { total += counter.value; });
+        assert(total == 1000);
+    }
+    // WorkerLocal析构时销毁所有对象
+    assert(alive == 0);
+}
+
+// 钩子在工作线程上执行：启动钩子在线程执行任务之前，可以访问WorkerLocal；退出钩子按注册顺序执行，
+// 在WorkerLocal之前注册的退出钩子还能访问退出线程的对象，之后注册的钩子执行时对象已经销毁
+static void testHookOrder()
+{
+    std::atomic<int> alive{0};
+    std::mutex mtx;
+    std::vector<std::string> events; // 工作线程退出时依次发生的事件
+    std::atomic<int> started{0};
+    std::atomic<WorkerLocal<Counter> *> localPtr{nullptr};
+
+    ThreadPool pool;
+    pool.onWorkerStart([&](int threadId)
+    {
+        assert(pool.currentWorkerId() == threadId);
+        localPtr.load()->get().value = threadId;
+        started++;
+    });
+    pool.onWorkerStop([&](int threadId)
+    {
+        assert(pool.currentWorkerId() == threadId);
+        WorkerLocal<Counter> *local = localPtr;
+        if(local != nullptr)
+        {
+            std::unique_lock<std::mutex> lock(mtx);
+            events.emplace_back((*local)->value == (uint64_t)threadId ? "before:own" : "before:other");
+        }
+    });
+    {
+        WorkerLocal<Counter> local(pool, [&]() { return std::make_unique<Counter>(alive); });
+        localPtr = &local;
+        pool.onWorkerStop([&](int)
+        {
+            std::unique_lock<std::mutex> lock(mtx);
+            events.emplace_back("after:" + std::to_string(alive.load()));
+        });
+        int removed = pool.onWorkerStop([](int) { assert(false); });
+        pool.removeWorkerHook(removed);
+
+        pool.start(1);
+        assert(pool.submitTask([&]() { return local->value == (uint64_t)pool.currentWorkerId(); }).get());
+
+        // 加一个线程再缩回去，退出的线程先看到自己的对象，然后对象被销毁
+        assert(pool.resize(2));
+        assert(waitUntil([&]() { return started == 2; }));
+        assert(local.size() == 2);
+        assert(pool.resize(1));
+        assert(waitUntil([&]() { std::unique_lock<std::mutex> lock(mtx); return events.size() == 2; }));
+        {
+            std::unique_lock<std::mutex> lock(mtx);
+            assert(events[0] == "before:own");
+            assert(events[1] == "after:1");
+        }
+        assert(local.size() == 1);
+        localPtr = nullptr;
+    }
+    assert(alive == 0);
+}
+
+int main()
+{
+    testIdleReclaim(std::chrono::milliseconds(0));
+    testIdleReclaim(std::chrono::milliseconds(200));
+    testWorkerLocal();
+    testHookOrder();
+    testThresholdLive();
+    std::cout << "worker_test passed" << std::endl;
+    return 0;
+}
@@ -3,6 +3,7 @@
 
 #include<vector>
 #include<queue>
+#include<deque>
 #include<memory>
 #include<atomic>
 #include<mutex>
@@ -10,13 +11,28 @@
 #include<functional>
 #include<stdexcept>
 #include<unordered_map>
+#include<unordered_set>
 #include<thread>
 #include<future>
 #include<iostream>
+#include<string>
+#include<algorithm>
+#include<list>
+#include<typeindex>
+#include<cstdint>
+#include<cstddef>
+#include<new>
+#include<type_traits>
+#include<sys/epoll.h>
+#include<sys/eventfd.h>
+#include<unistd.h>
 
-const int TASK_MAX_THRESHHOLD = 2; // INT32_MAX;
+const int TASK_MAX_THRESHHOLD = INT32_MAX;
 const int THREAD_MAX_THRESHHOLD = 1024;
 const int THREAD_MAX_IDLE_TIME = 60; // 60秒
+const uint64_t GROUP_STRIDE = 256; // 资源组步进调度的权重基准，虚拟时间按 执行时间(纳秒) * GROUP_STRIDE / weight 推进
+const size_t MEMO_SHARD_COUNT = 16; // 记忆化缓存的分片数量
+const size_t MEMO_DEFAULT_CAPACITY = 4096; // 记忆化缓存默认最多保存的结果数量
 
 // 线程池支持的模式
 enum class PoolMode
@@ -35,7 +51,7 @@ public:
     // 线程构造函数
     Thread(ThreadFunc func)
         :func_(func)
-        , threadId_(generatedId_++)
+        , threadId_(generatedId_.fetch_add(1))
     {}
 
     // 线程析构
@@ -59,137 +75,1822 @@ public:
 
 private:
     ThreadFunc func_;
-    static int generatedId_; // 产生递增的线程ID，因为只有线程池线程访问，所以无需原子变量
+    static std::atomic_int generatedId_; // 产生递增的线程ID，进程内多个线程池、多个用户线程可能同时创建线程，需要原子变量
     int threadId_; // 保存线程id
 };
 
-int Thread::generatedId_ = 0;
+std::atomic_int Thread::generatedId_(0);
 
 // 线程池类型
-class ThreadPool
+// 非阻塞提交的结果状态
+enum class SubmitStatus
 {
+    OK,         // 提交成功
+    QUEUE_FULL, // 资源组的任务队列已满
+    REJECTED,   // 被准入策略拒绝
+};
+
+// 非阻塞提交的返回值，提交失败时future中是空返回值
+template<typename R>
+struct SubmitResult
+{
+    SubmitStatus status;
+    std::future<R> future;
+};
+
+// 任务的亲和性提示：优先交给某个工作线程执行，让访问同一份数据的连续任务落在同一个线程上，缓存保持热
+// 工作线程按槽位编号（0到线程数-1），槽位和线程id无关，线程退出后它的槽位由之后创建的线程接管
+struct Affinity
+{
+    enum Kind
+    {
+        NONE,   // 没有偏好，进入资源组的共享队列
+        WORKER, // 指定工作线程槽位
+        KEY,    // 局部性键的哈希值
+    };
+
+    static Affinity none()
+    {
+        return Affinity{NONE, 0};
+    }
+
+    // 指定工作线程槽位，超出范围时取模；槽位的线程忙时任务会被空闲线程窃取，不保证在指定的线程上执行
+    static Affinity worker(size_t slot)
+    {
+        return Affinity{WORKER, slot};
+    }
+
+    // 按局部性键（分片号、分区号等）选择工作线程，相同的键总是落在同一个线程上
+    template<typename Key>
+    static Affinity key(const Key &key)
+    {
+        return Affinity{KEY, std::hash<Key>()(key)};
+    }
+
+    Kind kind;
+    size_t value;
+};
+
+// 提交时的准入策略，在线程池的锁外调用，实现需要自己保证线程安全
+// tag是提交时给任务打的标签（租户、任务类型等），需要是字符串字面量等长期有效的字符串，可以为nullptr
+class AdmissionPolicy
+{
+public:
+    virtual ~AdmissionPolicy() = default;
+
+    // 提交时调用，返回false表示拒绝这个任务
+    virtual bool admit(const char *tag) = 0;
+
+    // 已经被admit接受的任务最终没有进入队列（后面的策略拒绝或者队列已满）时调用，用来归还占用的名额
+    virtual void onCancel(const char *)
+    {}
+
+    // 任务开始执行时调用，参数为标签和在队列中等待的时间
+    virtual void onStart(const char *, std::chrono::nanoseconds)
+    {}
+
+    // 任务执行完成时调用，参数为标签和从提交到执行完成的时间，在任务的结果交给future之前调用
+    virtual void onComplete(const char *, std::chrono::nanoseconds)
+    {}
+};
+
+// 任务执行情况的观察者，每个任务执行完成后在工作线程中调用，实现需要自己保证线程安全
+// 调用发生在任务的结果交给future之前，所以future.get()返回时这个任务已经报告过
+class TaskObserver
+{
+public:
+    virtual ~TaskObserver() = default;
+
+    // group为资源组名字（驻留的字符串，资源组销毁后仍然有效），tag为提交时的标签（可以为nullptr），wait为排队时间，run为执行时间
+    virtual void onTaskDone(const char *group, const char *tag, std::chrono::nanoseconds wait, std::chrono::nanoseconds run) = 0;
+};
+
+// 当前线程正在执行的任务，每个线程一份，由工作线程在执行任务前后更新
+// 只包含平凡类型，可以在采样信号处理函数中读取
+struct TaskTrace
+{
+    const char *group; // 资源组名字，指向internTraceName驻留的字符串，资源组和线程池销毁后仍然有效
+    const char *tag; // 提交时的标签
+    bool worker; // 当前线程是不是工作线程
+    bool running; // 是否正在执行任务，false表示在等待或者调度
+};
+
+inline TaskTrace &currentTaskTrace()
+{
+    static thread_local TaskTrace trace{nullptr, nullptr, false, false};
+    return trace;
+}
+
+// 把资源组名字复制到整个进程生命周期都有效的存储中，相同的名字返回同一个指针
+// 性能分析器按指针记录名字，资源组或者线程池先于分析器销毁时也不会访问已经释放的内存；名字只增不减
+inline const char *internTraceName(const std::string &name)
+{
+    static std::mutex mtx;
+    static std::unordered_set<std::string> *names = new std::unordered_set<std::string>(); // 不析构，退出阶段仍可能被读取
+    std::unique_lock<std::mutex> lock(mtx);
+    return names->insert(name).first->c_str();
+}
+
+// 用来区分用户键类型和返回值类型的标签
+template<typename Key, typename R>
+struct MemoTag
+{};
+
+// 记忆化缓存的键：类型擦除后的用户键，同一个键对应不同返回值类型时视为不同的键
+struct MemoKey
+{
+    std::type_index type; // typeid(MemoTag<Key, 返回值类型>)
+    size_t hash;
+    std::shared_ptr<const void> key; // 查找时不拥有用户键，插入时保存一份拷贝
+    bool (*equal)(const void *, const void *);
+
+    bool operator==(const MemoKey &other) const
+    {
+        return type == other.type && hash == other.hash && equal(key.get(), other.key.get());
+    }
+};
+
+struct MemoKeyHash
+{
+    size_t operator()(const MemoKey &key) const
+    {
+        return key.hash;
+    }
+};
+
+class MemoCache;
+
+// 一次进行中的计算，由第一个提交者创建，结果通过promise分享给所有相同键的调用方
+// 计算抛出异常或者任务没能提交，析构时把条目从缓存中删除，后续调用会重新计算
+template<typename R>
+struct MemoFlight
+{
+    MemoFlight(MemoCache *cache, MemoKey key, uint64_t generation)
+        : cache(cache)
+        , key(std::move(key))
+        , generation(generation)
+        , done(false)
+    {}
+
+    ~MemoFlight();
+
+    template<typename Call>
+    void run(Call &call)
+    {
+        try
+        {
+            if constexpr (std::is_void<R>::value)
+            {
+                call();
+                promise.set_value();
+            }
+            else
+            {
+                promise.set_value(call());
+            }
+            done = true;
+        }
+        catch(...)
+        {
+            promise.set_exception(std::current_exception());
+        }
+    }
+
+    MemoCache *cache;
+    MemoKey key;
+    uint64_t generation; // 条目的版本号，避免删掉同一个键后来插入的条目
+    bool done;
+    std::promise<R> promise;
+};
+
+// 记忆化缓存：分片的并发哈希表，每个分片独立加锁、按LRU淘汰
+class MemoCache
+{
+public:
+    // 统计信息
+    struct Stats
+    {
+        uint64_t hits;      // 命中已经完成的结果
+        uint64_t misses;    // 未命中，发起了新的计算
+        uint64_t collapses; // 命中进行中的计算，合并为同一次执行
+        uint64_t evictions; // 因容量限制被淘汰的条目
+        size_t size;        // 当前条目数量
+    };
+
+    explicit MemoCache(size_t capacity = MEMO_DEFAULT_CAPACITY)
+        : shardCapacity_(std::max<size_t>(1, capacity / MEMO_SHARD_COUNT))
+        , generation_(0)
+        , hits_(0)
+        , misses_(0)
+        , collapses_(0)
+        , evictions_(0)
+    {}
+
+    // 查找键对应的结果；不存在时插入一个进行中的条目，并通过flight返回给调用方负责计算
+    template<typename R, typename Key>
+    std::shared_future<R> lookup(const Key &key, std::shared_ptr<MemoFlight<R>> &flight)
+    {
+        MemoKey probe{typeid(MemoTag<Key, R>), std::hash<Key>()(key),
+                      std::shared_ptr<const void>(std::shared_ptr<const void>(), &key), &equalKey<Key>};
+        Shard &shard = shards_[shardIndex(probe.hash)];
+
+        std::unique_lock<std::mutex> lock(shard.mtx);
+        auto it = shard.index.find(probe);
+        if(it != shard.index.end())
+        {
+            // 移到LRU链表头部
+            shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+            auto result = *std::static_pointer_cast<std::shared_future<R>>(it->second->result);
+            if(result.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+            {
+                hits_++;
+            }
+            else
+            {
+                collapses_++;
+            }
+            return result;
+        }
+
+        misses_++;
+        MemoKey owned{probe.type, probe.hash, std::make_shared<Key>(key), probe.equal};
+        flight = std::make_shared<MemoFlight<R>>(this, owned, ++generation_);
+        auto result = std::make_shared<std::shared_future<R>>(flight->promise.get_future().share());
+        shard.lru.push_front(Entry{owned, result, flight->generation});
+        shard.index.emplace(std::move(owned), shard.lru.begin());
+
+        // 超过容量时淘汰最久没有访问的条目，进行中的条目被淘汰不影响已经拿到结果的调用方
+        while(shard.lru.size() > shardCapacity_.load(std::memory_order_relaxed))
+        {
+            shard.index.erase(shard.lru.back().key);
+            shard.lru.pop_back();
+            evictions_++;
+        }
+        return *result;
+    }
+
+    // 删除键对应的条目，只有版本号一致时才删除
+    void erase(const MemoKey &key, uint64_t generation)
+    {
+        Shard &shard = shards_[shardIndex(key.hash)];
+        std::unique_lock<std::mutex> lock(shard.mtx);
+        auto it = shard.index.find(key);
+        if(it != shard.index.end() && it->second->generation == generation)
+        {
+            shard.lru.erase(it->second);
+            shard.index.erase(it);
+        }
+    }
+
+    // 修改容量，超出的部分在之后的插入中淘汰
+    void setCapacity(size_t capacity)
+    {
+        shardCapacity_.store(std::max<size_t>(1, capacity / MEMO_SHARD_COUNT), std::memory_order_relaxed);
+    }
+
+    // 清空缓存，进行中的计算仍然会完成并通知已经拿到结果的调用方
+    void clear()
+    {
+        for(auto &shard : shards_)
+        {
+            std::unique_lock<std::mutex> lock(shard.mtx);
+            shard.index.clear();
+            shard.lru.clear();
+        }
+    }
+
+    Stats stats()
+    {
+        size_t size = 0;
+        for(auto &shard : shards_)
+        {
+            std::unique_lock<std::mutex> lock(shard.mtx);
+            size += shard.lru.size();
+        }
+        return Stats{hits_, misses_, collapses_, evictions_, size};
+    }
+
+private:
+    template<typename Key>
+    static bool equalKey(const void *a, const void *b)
+    {
+        return *static_cast<const Key *>(a) == *static_cast<const Key *>(b);
+    }
+
+    static size_t shardIndex(size_t hash)
+    {
+        // 打散用户哈希的低位，std::hash<int>等是恒等映射
+        return (hash * 0x9E3779B97F4A7C15ull) >> 32 & (MEMO_SHARD_COUNT - 1);
+    }
+
+    struct Entry
+    {
+        MemoKey key;
+        std::shared_ptr<void> result; // std::shared_future<R>
+        uint64_t generation;
+    };
+
+    struct Shard
+    {
+        std::mutex mtx;
+        std::list<Entry> lru; // 头部是最近访问的条目
+        std::unordered_map<MemoKey, std::list<Entry>::iterator, MemoKeyHash> index;
+    };
+
+    Shard shards_[MEMO_SHARD_COUNT];
+    std::atomic<size_t> shardCapacity_; // 每个分片的容量，所有分片共用，查找时在各自的分片锁下读取，修改时不需要持有分片锁
+    std::atomic<uint64_t> generation_;
+    std::atomic<uint64_t> hits_;
+    std::atomic<uint64_t> misses_;
+    std::atomic<uint64_t> collapses_;
+    std::atomic<uint64_t> evictions_;
+};
+
+template<typename R>
+MemoFlight<R>::~MemoFlight()
+{
+    if(!done)
+    {
+        cache->erase(key, generation);
+    }
+}
+
+// ---------------- 线程池的编译期策略 ----------------
+// BasicThreadPool<QueuePolicy, WaitPolicy, TaskStorage, Allocator, Config>通过模板参数组合，没有虚函数开销
+// ThreadPool是默认组合：std::deque队列、std::mutex + std::condition_variable、std::function任务、std::allocator
+
+// 自旋等待时让出流水线，减少对超线程兄弟的影响
+inline void cpuRelax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+}
+
+const int SPIN_YIELD_THRESHHOLD = 1024; // 自旋多少次之后开始让出CPU，避免线程数超过核数时空转
+
+// 自旋锁，满足Lockable要求，可以配合std::unique_lock使用
+class SpinMutex
+{
+public:
+    void lock()
+    {
+        int spins = 0;
+        while(locked_.exchange(true, std::memory_order_acquire))
+        {
+            while(locked_.load(std::memory_order_relaxed))
+            {
+                if(++spins < SPIN_YIELD_THRESHHOLD)
+                {
+                    cpuRelax();
+                }
+                else
+                {
+                    std::this_thread::yield();
+                }
+            }
+        }
+    }
+
+    bool try_lock()
+    {
+        return !locked_.load(std::memory_order_relaxed) && !locked_.exchange(true, std::memory_order_acquire);
+    }
+
+    void unlock()
+    {
+        locked_.store(false, std::memory_order_release);
+    }
+
+private:
+    std::atomic<bool> locked_{false};
+};
+
+// 忙等的条件变量：等待方释放锁后自旋观察通知计数，不进入内核睡眠，唤醒延迟最低但空闲时占满CPU
+// 接口与std::condition_variable相同，允许虚假唤醒；通知需要在锁下进行，否则可能丢失
+class SpinCondition
+{
+public:
+    void notify_one()
+    {
+        epoch_.fetch_add(1, std::memory_order_release);
+    }
+
+    void notify_all()
+    {
+        epoch_.fetch_add(1, std::memory_order_release);
+    }
+
+    template<typename Lock>
+    void wait(Lock &lock)
+    {
+        waitUntil(lock, std::chrono::steady_clock::time_point::max());
+    }
+
+    template<typename Lock, typename Pred>
+    void wait(Lock &lock, Pred pred)
+    {
+        while(!pred())
+        {
+            wait(lock);
+        }
+    }
+
+    template<typename Lock, typename Rep, typename Period>
+    std::cv_status wait_for(Lock &lock, const std::chrono::duration<Rep, Period> &timeout)
+    {
+        return waitUntil(lock, std::chrono::steady_clock::now() + timeout);
+    }
+
+    template<typename Lock, typename Rep, typename Period, typename Pred>
+    bool wait_for(Lock &lock, const std::chrono::duration<Rep, Period> &timeout, Pred pred)
+    {
+        auto deadline = std::chrono::steady_clock::now() + timeout;
+        while(!pred())
+        {
+            if(waitUntil(lock, deadline) == std::cv_status::timeout)
+            {
+                return pred();
+            }
+        }
+        return true;
+    }
+
+private:
+    template<typename Lock>
+    std::cv_status waitUntil(Lock &lock, std::chrono::steady_clock::time_point deadline)
+    {
+        uint64_t epoch = epoch_.load(std::memory_order_acquire);
+        lock.unlock();
+        std::cv_status status = std::cv_status::no_timeout;
+        for(int spins = 0; epoch_.load(std::memory_order_acquire) == epoch; ++spins)
+        {
+            if(spins < SPIN_YIELD_THRESHHOLD)
+            {
+                cpuRelax();
+                continue;
+            }
+            std::this_thread::yield();
+            if(std::chrono::steady_clock::now() >= deadline)
+            {
+                status = std::cv_status::timeout;
+                break;
+            }
+        }
+        lock.lock();
+        return status;
+    }
+
+    std::atomic<uint64_t> epoch_{0}; // 通知计数，等待方观察到变化即被唤醒
+};
+
+// 等待策略：任务队列的锁和条件变量类型
+// 默认：空闲线程在内核中睡眠
+struct BlockingWaitPolicy
+{
+    using Mutex = std::mutex;
+    using CondVar = std::condition_variable;
+};
+
+// 忙等：适合延迟敏感、核数充足的场景，空闲的工作线程会一直占用CPU
+struct SpinWaitPolicy
+{
+    using Mutex = SpinMutex;
+    using CondVar = SpinCondition;
+};
+
+// 基于环形数组的队列，接口是std::queue的子集，不是线程安全的（由线程池的锁保护）
+// 元素连续存放，每次入队不需要分配节点，容量不够时翻倍扩容
+template<typename T, typename Alloc = std::allocator<T>>
+class RingQueue
+{
+public:
+    explicit RingQueue(const Alloc &alloc = Alloc())
+        : alloc_(alloc)
+        , buf_(nullptr)
+        , cap_(0)
+        , head_(0)
+        , size_(0)
+    {}
+
+    ~RingQueue()
+    {
+        while(!empty())
+        {
+            pop();
+        }
+        if(buf_ != nullptr)
+        {
+            AllocTraits::deallocate(alloc_, buf_, cap_);
+        }
+    }
+
+    RingQueue(const RingQueue &) = delete;
+    RingQueue &operator=(const RingQueue &) = delete;
+
+    bool empty() const
+    {
+        return size_ == 0;
+    }
+
+    size_t size() const
+    {
+        return size_;
+    }
+
+    T &front()
+    {
+        return buf_[head_];
+    }
+
+    template<typename... Args>
+    void emplace(Args&&... args)
+    {
+        if(size_ == cap_)
+        {
+            grow();
+        }
+        AllocTraits::construct(alloc_, buf_ + ((head_ + size_) & (cap_ - 1)), std::forward<Args>(args)...);
+        size_++;
+    }
+
+    void push(T &&value)
+    {
+        emplace(std::move(value));
+    }
+
+    void pop()
+    {
+        AllocTraits::destroy(alloc_, buf_ + head_);
+        head_ = (head_ + 1) & (cap_ - 1);
+        size_--;
+    }
+
+private:
+    using AllocTraits = std::allocator_traits<Alloc>;
+
+    // 容量保持为2的幂，下标用位与取模
+    void grow()
+    {
+        size_t cap = cap_ == 0 ? 16 : cap_ * 2;
+        T *buf = AllocTraits::allocate(alloc_, cap);
+        for(size_t i = 0; i < size_; ++i)
+        {
+            T *old = buf_ + ((head_ + i) & (cap_ - 1));
+            AllocTraits::construct(alloc_, buf + i, std::move(*old));
+            AllocTraits::destroy(alloc_, old);
+        }
+        if(buf_ != nullptr)
+        {
+            AllocTraits::deallocate(alloc_, buf_, cap_);
+        }
+        buf_ = buf;
+        cap_ = cap;
+        head_ = 0;
+    }
+
+    Alloc alloc_;
+    T *buf_;
+    size_t cap_;
+    size_t head_; // 队头下标
+    size_t size_;
+};
+
+// 队列策略：资源组任务队列的容器类型
+// 默认：std::queue + std::deque
+struct DequeQueuePolicy
+{
+    template<typename T, typename Alloc>
+    using Queue = std::queue<T, std::deque<T, Alloc>>;
+};
+
+// 环形数组，入队出队没有节点分配
+struct RingQueuePolicy
+{
+    template<typename T, typename Alloc>
+    using Queue = RingQueue<T, Alloc>;
+};
+
+// 固定容量的任务对象，可调用对象直接构造在内部缓冲区中，不做任何堆分配，只能移动
+// 可调用对象超过Size字节时编译报错，需要调大Size；用作TaskStorage时，提交的任务不需要可拷贝
+template<size_t Size = 64>
+class InplaceTask
+{
+public:
+    InplaceTask() noexcept
+        : ops_(nullptr)
+    {}
+
+    InplaceTask(std::nullptr_t) noexcept
+        : ops_(nullptr)
+    {}
+
+    template<typename Func, typename = typename std::enable_if<!std::is_same<typename std::decay<Func>::type, InplaceTask>::value>::type>
+    InplaceTask(Func&& func)
+    {
+        using F = typename std::decay<Func>::type;
+        static_assert(sizeof(F) <= Size, "callable is too large for InplaceTask, increase Size");
+        static_assert(alignof(F) <= alignof(std::max_align_t), "callable is over-aligned for InplaceTask");
+        ::new (static_cast<void *>(storage_)) F(std::forward<Func>(func));
+        ops_ = opsFor<F>();
+    }
+
+    InplaceTask(InplaceTask &&other) noexcept
+        : ops_(other.ops_)
+    {
+        if(ops_ != nullptr)
+        {
+            ops_->move(storage_, other.storage_);
+            other.reset();
+        }
+    }
+
+    InplaceTask &operator=(InplaceTask &&other) noexcept
+    {
+        if(this != &other)
+        {
+            reset();
+            ops_ = other.ops_;
+            if(ops_ != nullptr)
+            {
+                ops_->move(storage_, other.storage_);
+                other.reset();
+            }
+        }
+        return *this;
+    }
+
+    ~InplaceTask()
+    {
+        reset();
+    }
+
+    void operator()()
+    {
+        ops_->invoke(storage_);
+    }
+
+    explicit operator bool() const noexcept
+    {
+        return ops_ != nullptr;
+    }
+
+    friend bool operator==(const InplaceTask &task, std::nullptr_t) noexcept
+    {
+        return task.ops_ == nullptr;
+    }
+
+    friend bool operator!=(const InplaceTask &task, std::nullptr_t) noexcept
+    {
+        return task.ops_ != nullptr;
+    }
+
+private:
+    // 每种可调用对象类型一张操作表，代替虚函数
+    struct Ops
+    {
+        void (*invoke)(void *);
+        void (*move)(void *, void *); // 从第二个参数移动构造到第一个参数
+        void (*destroy)(void *);
+    };
+
+    template<typename F>
+    static const Ops *opsFor()
+    {
+        static const Ops ops{
+            [](void *self) { (*static_cast<F *>(self))(); },
+            [](void *dst, void *src) { ::new (dst) F(std::move(*static_cast<F *>(src))); },
+            [](void *self) { static_cast<F *>(self)->~F(); }};
+        return &ops;
+    }
+
+    void reset() noexcept
+    {
+        if(ops_ != nullptr)
+        {
+            ops_->destroy(storage_);
+            ops_ = nullptr;
+        }
+    }
+
+    alignas(std::max_align_t) unsigned char storage_[Size];
+    const Ops *ops_;
+};
+
+// 线程池的常量配置，自定义时继承后覆盖需要修改的成员
+struct DefaultPoolConfig
+{
+    static constexpr size_t TASK_QUE_THRESHHOLD = TASK_MAX_THRESHHOLD; // 任务队列上限阈值
+    static constexpr int THREAD_THRESHHOLD = THREAD_MAX_THRESHHOLD; // cached模式下线程数量上限阈值
+    static constexpr int THREAD_IDLE_TIME = THREAD_MAX_IDLE_TIME; // cached模式下多余线程的最大空闲时间（秒）
+    static constexpr size_t AFFINITY_STEAL_THRESHHOLD = 4; // 槽位的线程在等待任务时，槽位积压超过多少个任务空闲线程才去窃取
+};
+
+template<typename QueuePolicy = DequeQueuePolicy,
+         typename WaitPolicy = BlockingWaitPolicy,
+         typename TaskStorage = std::function<void()>,
+         typename Allocator = std::allocator<char>,
+         typename Config = DefaultPoolConfig>
+class BasicThreadPool;
+
+// 默认的线程池
+using ThreadPool = BasicThreadPool<>;
+
+template<typename T, typename Pool = ThreadPool>
+class WorkerLocal;
+
+/*
+example:
+ThreadPool pool;
+pool.start(8);
+
+// 多个逻辑执行器共享同一组工作线程，按权重分配CPU，空闲的份额可以借给其他资源组
+auto compaction = pool.createGroup("compaction", 1, 2); // 权重1，最多同时占用2个线程
+auto request = pool.createGroup("request", 4);          // 权重4，不限制并发
+
+request->submitTask(handle, req);
+compaction->submitTask(compact, level);
+pool.submitTask(sum1, 10, 20); // 线程池本身就是默认资源组
+
+// 延迟敏感的路径：环形队列 + 忙等 + 无堆分配的任务对象
+using FastPool = BasicThreadPool<RingQueuePolicy, SpinWaitPolicy, InplaceTask<64>>;
+FastPool fast;
+fast.start(2);
+fast.submitTask(onTick, tick);
+*/
+template<typename QueuePolicy, typename WaitPolicy, typename TaskStorage, typename Allocator, typename Config>
+class BasicThreadPool
+{
+private:
+    using Task = TaskStorage; // 无法确定传入的函数类型，需要中间层解决，此处直接定义为void()的可调用对象即可
+    using Mutex = typename WaitPolicy::Mutex;
+    using CondVar = typename WaitPolicy::CondVar;
+    using Lock = std::unique_lock<Mutex>;
+    using AdmissionList = std::vector<std::shared_ptr<AdmissionPolicy>>;
+
+    // 任务队列中的元素
+    struct TaskItem
+    {
+        Task task;
+        const char *tag; // 提交时的标签
+        std::shared_ptr<const AdmissionList> policies; // 提交时生效的准入策略，没有策略时为空，不记录时间
+        std::chrono::steady_clock::time_point enqueueTime; // 入队时间，只有存在准入策略或者观察者时才记录
+    };
+
+    using TaskQueue = typename QueuePolicy::template Queue<TaskItem, typename std::allocator_traits<Allocator>::template rebind_alloc<TaskItem>>;
+
+    // 提交的任务：执行可调用对象，先报告任务完成，再把返回值或异常交给promise
+    // 这样future就绪时，准入策略、观察者和完成计数都已经看到这个任务
+    template<typename R, typename Call>
+    struct PromiseTask
+    {
+        void operator()()
+        {
+            try
+            {
+                if constexpr (std::is_void<R>::value)
+                {
+                    call();
+                    reportTaskDone();
+                    promise.set_value();
+                }
+                else
+                {
+                    R result = call();
+                    reportTaskDone();
+                    promise.set_value(std::forward<R>(result));
+                }
+            }
+            catch(...)
+            {
+                reportTaskDone();
+                promise.set_exception(std::current_exception());
+            }
+        }
+
+        std::promise<R> promise;
+        Call call;
+    };
+
 public:
-    // 线程池构造
-    ThreadPool()
+    // 资源组：共享线程池工作线程的逻辑执行器，拥有独立的任务队列、权重、并发上限和统计信息
+    class TaskGroup : public std::enable_shared_from_this<TaskGroup>
+    {
+    public:
+        // 资源组的统计信息快照
+        struct Stats
+        {
+            uint64_t submitted; // 成功提交的任务数量
+            uint64_t rejected;  // 因队列满而提交失败的任务数量
+            uint64_t completed; // 执行完成的任务数量
+            size_t queued;      // 当前排队中的任务数量
+            size_t running;     // 当前正在执行的任务数量
+        };
+
+        TaskGroup(BasicThreadPool *pool, std::string name, unsigned weight, size_t maxConcurrency, size_t threshhold)
+            : pool_(pool)
+            , name_(std::move(name))
+            , traceName_(internTraceName(name_))
+            , weight_(weight == 0 ? 1 : weight)
+            , maxConcurrency_(maxConcurrency)
+            , taskQueThreshHold_(threshhold)
+            , taskQue_(pool->alloc_)
+            , affineQueued_(0)
+            , running_(0)
+            , pass_(0)
+            , avgCharge_(0)
+            , removed_(false)
+            , submitted_(0)
+            , rejected_(0)
+            , completed_(0)
+        {}
+
+        TaskGroup(const TaskGroup &) = delete;
+        TaskGroup &operator=(const TaskGroup &) = delete;
+
+        // 向该资源组提交任务，用法与ThreadPool::submitTask相同
+        template<typename Func, typename... Args>
+        auto submitTask(Func&& func, Args&&... args) ->std::future<decltype(func(args...))>
+        {
+            SubmitStatus status;
+            return pool_->submitTaskTo(this, nullptr, Affinity::none(), true, status, std::forward<Func>(func), std::forward<Args>(args)...);
+        }
+
+        // 向该资源组提交带亲和性提示的任务，用法与ThreadPool::submitTask(Affinity, ...)相同
+        template<typename Func, typename... Args>
+        auto submitTask(Affinity affinity, Func&& func, Args&&... args) ->std::future<decltype(func(args...))>
+        {
+            SubmitStatus status;
+            return pool_->submitTaskTo(this, nullptr, affinity, true, status, std::forward<Func>(func), std::forward<Args>(args)...);
+        }
+
+        // 向该资源组提交带标签的任务，用法与ThreadPool::submitTaggedTask相同
+        template<typename Func, typename... Args>
+        auto submitTaggedTask(const char *tag, Func&& func, Args&&... args) ->std::future<decltype(func(args...))>
+        {
+            SubmitStatus status;
+            return pool_->submitTaskTo(this, tag, Affinity::none(), true, status, std::forward<Func>(func), std::forward<Args>(args)...);
+        }
+
+        // 向该资源组非阻塞提交带标签的任务，用法与ThreadPool::trySubmitTask相同
+        template<typename Func, typename... Args>
+        auto trySubmitTask(const char *tag, Func&& func, Args&&... args) ->SubmitResult<decltype(func(args...))>
+        {
+            SubmitStatus status;
+            auto result = pool_->submitTaskTo(this, tag, Affinity::none(), false, status, std::forward<Func>(func), std::forward<Args>(args)...);
+            return {status, std::move(result)};
+        }
+
+        // 修改资源组的队列上限，可以在线程池运行时调用；调小时已经排队的任务不受影响，之后的提交等待队列降到上限以下
+        void setQueueCapacity(size_t capacity)
+        {
+            Lock lock(pool_->taskQueMtx_);
+            taskQueThreshHold_ = capacity;
+            pool_->notFull_.notify_all();
+        }
+
+        const std::string &name() const
+        {
+            return name_;
+        }
+
+        unsigned weight() const
+        {
+            return weight_;
+        }
+
+        // 并发上限，0表示不限制
+        size_t maxConcurrency() const
+        {
+            return maxConcurrency_;
+        }
+
+        // 获取统计信息，队列长度需要在线程池的锁下读取
+        Stats stats() const
+        {
+            Lock lock(pool_->taskQueMtx_);
+            return Stats{submitted_, rejected_, completed_, taskQue_.size() + affineQueued_, running_};
+        }
+
+    private:
+        friend BasicThreadPool;
+
+        // 当前是否可以被工作线程调度：有任务排队且没有达到并发上限
+        bool runnable() const
+        {
+            return !taskQue_.empty() && (maxConcurrency_ == 0 || running_ < maxConcurrency_);
+        }
+
+        BasicThreadPool *pool_; // 所属的线程池，资源组只是逻辑执行器，线程由线程池统一持有
+        std::string name_;
+        const char *traceName_; // 驻留的名字，写入TaskTrace和报告给TaskObserver
+        unsigned weight_; // 权重，竞争时按权重比例分配工作线程
+        size_t maxConcurrency_; // 同时占用的工作线程上限
+        size_t taskQueThreshHold_; // 资源组任务队列上限阈值
+        TaskQueue taskQue_; // 资源组自己的任务队列，由线程池的taskQueMtx_保护
+        size_t affineQueued_; // 带亲和性提示、排在工作线程槽位中的任务数量，计入队列上限，由taskQueMtx_保护
+        std::atomic<size_t> running_; // 正在执行的任务数量，执行完成时不需要加锁就可以减少
+        // 步进调度的虚拟时间，按任务实际占用的CPU时间 / weight_推进，总是选择最小的资源组
+        // 调度时先按平均值预扣，任务执行完后按实际执行时间补差，避免长任务执行期间同一个资源组占满所有线程
+        std::atomic<uint64_t> pass_;
+        std::atomic<uint64_t> avgCharge_; // 每个任务虚拟时间增量的滑动平均，用作调度时的预扣值
+        std::atomic<bool> removed_; // 是否已经被removeGroup移除，在taskQueMtx_下修改，任务执行完成时不加锁读取
+
+        std::atomic<uint64_t> submitted_;
+        std::atomic<uint64_t> rejected_;
+        std::atomic<uint64_t> completed_;
+    };
+
+    // 线程池构造，allocator用于任务队列和任务的共享状态，会被多个提交线程并发使用，需要是线程安全的
+    explicit BasicThreadPool(const Allocator &alloc = Allocator())
         : initThreadSize_(4)
         , idleThreadSize_(0)
         , curThreadSize_(0)
-        , threadSizeThreshHold_(THREAD_MAX_THRESHHOLD)
+        , threadSizeThreshHold_(Config::THREAD_THRESHHOLD)
+        , blockedThreadSize_(0)
+        , compensateSize_(0)
+        , retireSize_(0)
         , taskSize_(0)
-        , taskQueThreshHold_(TASK_MAX_THRESHHOLD)
+        , globalPass_(0)
         , poolMode_(PoolMode::MODE_FIXED)
         , isPoolRunning_(false)
-    {}
+        , reactorFd_(-1)
+        , wakeFd_(-1)
+        , reactorPolling_(false)
+        , reactorSlot_(-1)
+        , hookId_(0)
+        , localSlots_(0)
+        , observing_(false)
+        , alloc_(alloc)
+    {
+        // 线程池本身的任务提交到默认资源组
+        defaultGroup_ = std::make_shared<TaskGroup>(this, "default", 1, 0, Config::TASK_QUE_THRESHHOLD);
+        groups_.emplace_back(defaultGroup_);
+    }
+
+    // 线程池析构，有构造必须析构
+    ~BasicThreadPool()
+    {
+        // 优雅退出
+        isPoolRunning_ = false;
+
+        // 等待线程池中所有线程返回，有两种状态，等待和执行；在锁下通知，避免等待方检查完状态还没开始等待时丢失唤醒
+        Lock lock(taskQueMtx_);
+        notEmpty_.notify_all();
+        wakeReactor();
+        exitCond_.wait(lock, [&]() -> bool
+                    { return threads_.size() == 0; });
+
+        if(reactorFd_ >= 0)
+        {
+            ::close(reactorFd_);
+            ::close(wakeFd_);
+        }
+    }
+    
+    // 开启线程池，只能调用一次，之后用resize调整线程数量
+    void start(int initThreadSize = std::thread::hardware_concurrency())
+    {
+        // 线程对象在锁下登记到线程列表，系统线程在锁外创建；线程启动后先拿锁才会访问线程列表
+        std::vector<Thread *> spawned;
+        {
+            Lock lock(taskQueMtx_);
+            if(isPoolRunning_)
+            {
+                return;
+            }
+
+            // 设置线程池的启动状态
+            isPoolRunning_ = true;
+
+            // 记录初始线程个数
+            initThreadSize_ = initThreadSize;
+
+            // 线程id是所有线程池共用的全局计数，不一定从0开始，需要用创建时拿到的id启动线程
+            for (int i = 0; i < initThreadSize; ++i)
+            {
+                spawned.emplace_back(addThread());
+            }
+        }
+        for(Thread *thread : spawned)
+        {
+            thread->start();
+        }
+    }
+    
+    // 获取当前线程数量
+    int getThreadSize() const
+    {
+        return curThreadSize_;
+    }
+
+    // 调整工作线程数量，只能在线程池运行时调用，不会丢失或者重复执行任务；启动前的线程数量由start的参数决定，启动前调用返回false
+    // 增加的线程立即参与调度；减少时多余的线程执行完手头的任务后退出，空闲线程立即退出
+    // cached模式下只调整常驻线程数量，多出来的线程按空闲时间回收
+    bool resize(int threadSize)
+    {
+        std::vector<Thread *> spawned;
+        {
+            Lock lock(taskQueMtx_);
+            if(threadSize <= 0)
+            {
+                return false;
+            }
+            if(!isPoolRunning_)
+            {
+                std::cerr << "thread pool is not running, resize fail." << std::endl;
+                return false;
+            }
+            threadSize = std::min(threadSize, (int)threadSizeThreshHold_);
+            initThreadSize_ = threadSize;
+
+            // 补偿阻塞区域的线程不计入目标数量，等待退出的线程已经不算存活
+            int target = threadSize + compensateSize_;
+            int live = curThreadSize_ - retireSize_;
+            if(live < target)
+            {
+                // 先撤销还没执行的退出请求，再创建新线程
+                int cancel = std::min(retireSize_, target - live);
+                retireSize_ -= cancel;
+                live += cancel;
+                for(; live < target; ++live)
+                {
+                    spawned.emplace_back(addThread());
+                }
+            }
+            else if(live > target && poolMode_ == PoolMode::MODE_FIXED)
+            {
+                retireSize_ += live - target;
+                notEmpty_.notify_all();
+                wakeReactor();
+            }
+        }
+        // 与start一样在锁外创建系统线程
+        for(Thread *thread : spawned)
+        {
+            thread->start();
+        }
+        return true;
+    }
+
+    // 修改默认资源组的队列上限，可以在线程池运行时调用
+    void setQueueCapacity(size_t capacity)
+    {
+        defaultGroup_->setQueueCapacity(capacity);
+    }
+
+    // 设置线程池的工作模式
+    void setMode(PoolMode mode)
+    {
+        // 不允许启动后再设置
+        if(checkRunninngState())
+        {
+            return;
+        }
+        poolMode_ = mode;
+    }
+
+    // 设置task任务队列上限阈值，等同于setQueueCapacity，可以在线程池运行时调用
+    void setTaskQueMaxThreshHold(int threshhold)
+    {
+        if(threshhold <= 0)
+        {
+            std::cerr << "task queue threshhold must be positive, set threshhold fail." << std::endl;
+            return;
+        }
+        setQueueCapacity((size_t)threshhold);
+    }
+
+    // 设置线程池cached模式下线程阈值，可以在线程池运行时调用，需要先设置cached模式；设置失败返回false
+    // 运行时调小不会立即结束线程，超出阈值的线程按空闲时间回收；不能小于常驻线程数量
+    bool setThreadSizeThreshHold(int threshhold)
+    {
+        Lock lock(taskQueMtx_);
+        if(poolMode_ != PoolMode::MODE_CACHED)
+        {
+            std::cerr << "thread pool is not in cached mode, set thread threshhold fail." << std::endl;
+            return false;
+        }
+        if(threshhold <= 0 || (isPoolRunning_ && threshhold < (int)initThreadSize_))
+        {
+            std::cerr << "thread threshhold is less than thread size, set thread threshhold fail." << std::endl;
+            return false;
+        }
+        threadSizeThreshHold_ = threshhold;
+        return true;
+    }
+
+    // 创建一个资源组，weight为CPU份额权重，maxConcurrency为同时占用的线程上限（0表示不限制），threshhold为资源组的队列上限
+    // 资源组之间共享线程池的工作线程，某个资源组空闲时，它的份额会被其他资源组使用
+    std::shared_ptr<TaskGroup> createGroup(std::string name,
+                                           unsigned weight = 1,
+                                           size_t maxConcurrency = 0,
+                                           size_t threshhold = Config::TASK_QUE_THRESHHOLD)
+    {
+        auto group = std::make_shared<TaskGroup>(this, std::move(name), weight, maxConcurrency, threshhold);
+        Lock lock(taskQueMtx_);
+        groups_.emplace_back(group);
+        sweepGroups();
+        return group;
+    }
+
+    // 移除资源组：之后向它提交的任务会被拒绝，已经排队的任务仍然会执行完，全部执行完后不再参与调度；默认资源组不能移除
+    bool removeGroup(const std::shared_ptr<TaskGroup> &group)
+    {
+        Lock lock(taskQueMtx_);
+        if(group == nullptr || group == defaultGroup_ || group->pool_ != this || group->removed_)
+        {
+            return false;
+        }
+        group->removed_ = true;
+        sweepGroups();
+        // 唤醒等待这个资源组队列空位的提交者，让它们返回拒绝
+        notFull_.notify_all();
+        return true;
+    }
+
+    // 获取默认资源组，线程池的submitTask提交到这里
+    std::shared_ptr<TaskGroup> defaultGroup() const
+    {
+        return defaultGroup_;
+    }
+
+    // 给线程池提交任务，使用可变参模板编程，使其可以接收任意任务函数和任意数量的参数
+    // pool.submitTask(sum1, 10, 20)
+    template<typename Func, typename... Args>
+    auto submitTask(Func&& func, Args&&... args) ->std::future<decltype(func(args...))>
+    {
+        SubmitStatus status;
+        return submitTaskTo(defaultGroup_.get(), nullptr, Affinity::none(), true, status, std::forward<Func>(func), std::forward<Args>(args)...);
+    }
+
+    // 提交带亲和性提示的任务：任务先放进对应工作线程的槽位队列，该线程优先执行自己槽位中的任务；
+    // 槽位的线程正在执行任务（包括阻塞区域）或者槽位没有线程时，空闲线程直接窃取，线程在等待任务时积压超过AFFINITY_STEAL_THRESHHOLD才窃取
+    // pool.submitTask(Affinity::key(partition), aggregate, partition, batch)
+    template<typename Func, typename... Args>
+    auto submitTask(Affinity affinity, Func&& func, Args&&... args) ->std::future<decltype(func(args...))>
+    {
+        SubmitStatus status;
+        return submitTaskTo(defaultGroup_.get(), nullptr, affinity, true, status, std::forward<Func>(func), std::forward<Args>(args)...);
+    }
+
+    // 提交带标签的任务，标签用于准入策略和性能分析（按标签统计CPU时间、排队时间和执行时间）
+    // tag需要是字符串字面量等长期有效的字符串
+    // pool.submitTaggedTask("compress", compress, block)
+    template<typename Func, typename... Args>
+    auto submitTaggedTask(const char *tag, Func&& func, Args&&... args) ->std::future<decltype(func(args...))>
+    {
+        SubmitStatus status;
+        return submitTaskTo(defaultGroup_.get(), tag, Affinity::none(), true, status, std::forward<Func>(func), std::forward<Args>(args)...);
+    }
+
+    // 非阻塞提交带标签的任务：经过准入策略，队列满时不等待notFull_，立即返回状态
+    // auto res = pool.trySubmitTask("tenant-a", handle, req);
+    // if(res.status != SubmitStatus::OK) { // 过载，快速失败 }
+    template<typename Func, typename... Args>
+    auto trySubmitTask(const char *tag, Func&& func, Args&&... args) ->SubmitResult<decltype(func(args...))>
+    {
+        SubmitStatus status;
+        auto result = submitTaskTo(defaultGroup_.get(), tag, Affinity::none(), false, status, std::forward<Func>(func), std::forward<Args>(args)...);
+        return {status, std::move(result)};
+    }
+
+    // 添加一个准入策略，所有提交（包括submitTask）都要依次经过全部策略，可以在运行时添加
+    // submitTask被拒绝时与队列满一样打印日志并返回空返回值，需要区分拒绝原因时使用trySubmitTask
+    void addAdmissionPolicy(std::shared_ptr<AdmissionPolicy> policy)
+    {
+        Lock lock(taskQueMtx_);
+        auto policies = std::make_shared<AdmissionList>(policies_ ? *policies_ : AdmissionList());
+        policies->emplace_back(std::move(policy));
+        std::atomic_store(&policies_, std::shared_ptr<const AdmissionList>(std::move(policies)));
+    }
+
+    // 设置任务观察者，每个任务执行完成后报告排队时间和执行时间，传入nullptr关闭；可以在运行时设置
+    void setTaskObserver(std::shared_ptr<TaskObserver> observer)
+    {
+        bool observing = observer != nullptr;
+        std::atomic_store(&observer_, std::move(observer));
+        observing_ = observing;
+    }
+
+    // 提交结果只取决于key的幂等任务：相同key的结果会被缓存，进行中的相同key只执行一次，所有调用方共享同一个结果
+    // pool.submitMemoized(userId, loadProfile, userId)
+    template<typename Key, typename Func, typename... Args>
+    auto submitMemoized(const Key &key, Func&& func, Args&&... args) ->std::shared_future<decltype(func(args...))>
+    {
+        using RType = decltype(func(args...));
+        std::shared_ptr<MemoFlight<RType>> flight;
+        std::shared_future<RType> result = memo_.lookup<RType>(key, flight);
+        if(flight != nullptr)
+        {
+            auto call = std::bind(std::forward<Func>(func), std::forward<Args>(args)...);
+            submitTask([flight, call]() mutable { flight->run(call); });
+        }
+        return result;
+    }
+
+    // 记忆化缓存的命中、未命中、合并执行次数
+    MemoCache::Stats memoStats()
+    {
+        return memo_.stats();
+    }
+
+    // 设置记忆化缓存最多保存的结果数量
+    void setMemoCapacity(size_t capacity)
+    {
+        memo_.setCapacity(capacity);
+    }
+
+    // 清空记忆化缓存
+    void clearMemo()
+    {
+        memo_.clear();
+    }
+
+    // 开启反应器：空闲的工作线程轮流作为leader等待epoll，就绪事件的回调由leader线程直接执行，不经过任务队列
+    // 成功返回true，可以在线程池启动前后调用
+    bool enableReactor()
+    {
+        Lock lock(taskQueMtx_);
+        if(reactorFd_ >= 0)
+        {
+            return true;
+        }
+        int epfd = ::epoll_create1(EPOLL_CLOEXEC);
+        if(epfd < 0)
+        {
+            return false;
+        }
+        int efd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.fd = efd;
+        if(efd < 0 || ::epoll_ctl(epfd, EPOLL_CTL_ADD, efd, &ev) < 0)
+        {
+            if(efd >= 0)
+            {
+                ::close(efd);
+            }
+            ::close(epfd);
+            return false;
+        }
+        reactorFd_ = epfd;
+        wakeFd_ = efd;
+        // 唤醒一个空闲线程成为leader
+        notEmpty_.notify_all();
+        return true;
+    }
+
+    // 注册fd，events为EPOLLIN、EPOLLOUT等，事件就绪时在工作线程中调用callback(就绪的events)
+    // 同一个fd的回调不会并发执行：内部使用EPOLLONESHOT，回调返回后重新监听
+    bool addFd(int fd, uint32_t events, std::function<void(uint32_t)> callback)
+    {
+        Lock lock(taskQueMtx_);
+        if(reactorFd_ < 0 || fdHandlers_.count(fd) > 0)
+        {
+            return false;
+        }
+        auto handler = std::make_shared<FdHandler>(FdHandler{fd, events, std::move(callback)});
+        epoll_event ev{};
+        ev.events = events | EPOLLONESHOT;
+        ev.data.fd = fd;
+        if(::epoll_ctl(reactorFd_, EPOLL_CTL_ADD, fd, &ev) < 0)
+        {
+            return false;
+        }
+        fdHandlers_.emplace(fd, std::move(handler));
+        return true;
+    }
+
+    // 修改fd监听的事件；回调正在执行时（包括在回调中修改）只记录新的事件，回调返回后再按新的事件重新监听
+    bool modifyFd(int fd, uint32_t events)
+    {
+        Lock lock(taskQueMtx_);
+        auto it = fdHandlers_.find(fd);
+        if(it == fdHandlers_.end())
+        {
+            return false;
+        }
+        it->second->events = events;
+        if(it->second->running)
+        {
+            return true;
+        }
+        epoll_event ev{};
+        ev.events = events | EPOLLONESHOT;
+        ev.data.fd = fd;
+        return ::epoll_ctl(reactorFd_, EPOLL_CTL_MOD, fd, &ev) == 0;
+    }
+
+    // 取消注册fd，已经在执行的回调会执行完，但之后不会再被调用
+    bool removeFd(int fd)
+    {
+        Lock lock(taskQueMtx_);
+        if(fdHandlers_.erase(fd) == 0)
+        {
+            return false;
+        }
+        ::epoll_ctl(reactorFd_, EPOLL_CTL_DEL, fd, nullptr);
+        return true;
+    }
+
+    // 工作线程生命周期钩子，参数为工作线程的id
+    using WorkerHook = std::function<void(int)>;
+
+    // 注册工作线程启动钩子，在新的工作线程执行任务之前调用，已经启动的线程不会补调，返回钩子id
+    int onWorkerStart(WorkerHook hook)
+    {
+        std::unique_lock<std::mutex> lock(hookMtx_);
+        startHooks_.emplace_back(++hookId_, std::move(hook));
+        return hookId_;
+    }
+
+    // 注册工作线程退出钩子，在工作线程退出（析构或者cached模式下空闲回收）时调用，返回钩子id
+    int onWorkerStop(WorkerHook hook)
+    {
+        std::unique_lock<std::mutex> lock(hookMtx_);
+        stopHooks_.emplace_back(++hookId_, std::move(hook));
+        return hookId_;
+    }
+
+    // 注销钩子
+    void removeWorkerHook(int hookId)
+    {
+        std::unique_lock<std::mutex> lock(hookMtx_);
+        auto match = [hookId](const std::pair<int, WorkerHook> &hook) -> bool
+        { return hook.first == hookId; };
+        startHooks_.erase(std::remove_if(startHooks_.begin(), startHooks_.end(), match), startHooks_.end());
+        stopHooks_.erase(std::remove_if(stopHooks_.begin(), stopHooks_.end(), match), stopHooks_.end());
+    }
+
+    // 当前线程如果是本线程池的工作线程，返回它的槽位，否则返回-1
+    int currentWorkerSlot() const
+    {
+        const WorkerContext &ctx = currentWorker();
+        return ctx.pool == this ? ctx.slot : -1;
+    }
+
+    // 当前线程如果是本线程池的工作线程，返回它的id，否则返回-1
+    int currentWorkerId() const
+    {
+        const WorkerContext &ctx = currentWorker();
+        return ctx.pool == this ? ctx.threadId : -1;
+    }
+
+    // 标记当前工作线程进入阻塞区域（阻塞的文件IO、等待锁等），线程池临时补偿一个工作线程，
+    // 保证可运行的CPU线程数仍然等于initThreadSize_；非线程池线程调用时什么也不做，可以嵌套调用
+    static void enterBlocking()
+    {
+        WorkerContext &ctx = currentWorker();
+        if(ctx.pool != nullptr && ctx.blockingDepth++ == 0)
+        {
+            ctx.pool->beginBlocking();
+        }
+    }
+
+    // 标记当前工作线程离开阻塞区域，多出来的补偿线程会在执行完手头的任务后退出
+    static void exitBlocking()
+    {
+        WorkerContext &ctx = currentWorker();
+        if(ctx.pool != nullptr && --ctx.blockingDepth == 0)
+        {
+            ctx.pool->endBlocking();
+        }
+    }
+
+    // 阻塞区域的RAII封装
+    // Any run() { ThreadPool::BlockingRegion region; return ::read(fd, buf, len); }
+    class BlockingRegion
+    {
+    public:
+        BlockingRegion()
+        {
+            BasicThreadPool::enterBlocking();
+        }
+
+        ~BlockingRegion()
+        {
+            BasicThreadPool::exitBlocking();
+        }
+
+        BlockingRegion(const BlockingRegion &) = delete;
+        BlockingRegion &operator=(const BlockingRegion &) = delete;
+    };
+
+    // 在阻塞区域中执行func并返回其结果
+    template<typename Func>
+    static auto managedBlock(Func&& func) ->decltype(func())
+    {
+        BlockingRegion region;
+        return func();
+    }
+
+    BasicThreadPool(const BasicThreadPool &) = delete;
+    BasicThreadPool &operator=(const BasicThreadPool &) = delete;
+private:
+    template<typename T, typename Pool>
+    friend class WorkerLocal;
+
+    // 工作线程槽位队列中的元素，任务仍然属于提交时的资源组
+    struct SlotItem
+    {
+        TaskGroup *group;
+        TaskItem item;
+    };
+
+    using SlotQueue = typename QueuePolicy::template Queue<SlotItem, typename std::allocator_traits<Allocator>::template rebind_alloc<SlotItem>>;
+
+    // 工作线程槽位：带亲和性提示的任务排在这里，由taskQueMtx_保护
+    struct WorkerSlot
+    {
+        explicit WorkerSlot(const Allocator &alloc)
+            : tasks(alloc)
+            , owned(false)
+            , busy(false)
+        {}
+
+        SlotQueue tasks;
+        bool owned; // 是否有工作线程占用这个槽位
+        bool busy; // 占用槽位的线程是否正在执行任务（包括阻塞区域），忙时槽位中的任务可以被空闲线程窃取
+    };
+
+    // 反应器中注册的fd及其回调
+    struct FdHandler
+    {
+        int fd;
+        uint32_t events; // 回调返回后重新监听的事件，由taskQueMtx_保护
+        std::function<void(uint32_t)> callback;
+        bool running = false; // 回调是否正在执行，由taskQueMtx_保护
+    };
+
+    // 唤醒正在epoll_wait的leader线程，调用方需要持有taskQueMtx_
+    void wakeReactor()
+    {
+        if(reactorPolling_)
+        {
+            uint64_t one = 1;
+            ssize_t n = ::write(wakeFd_, &one, sizeof(one));
+            (void)n;
+        }
+    }
+
+    // leader线程释放锁等待epoll，返回就绪的fd回调，没有就绪事件则返回nullptr；slot为leader的槽位
+    // 调用方需要持有taskQueMtx_，返回时仍然持有
+    std::shared_ptr<FdHandler> pollReactor(Lock &lock, int slot, int timeoutMs, uint32_t &revents)
+    {
+        reactorPolling_ = true;
+        reactorSlot_ = slot;
+        lock.unlock();
+        epoll_event ev{};
+        int n = ::epoll_wait(reactorFd_, &ev, 1, timeoutMs);
+        lock.lock();
+        reactorPolling_ = false;
+        reactorSlot_ = -1;
+
+        // 让出leader身份，唤醒一个follower接替等待epoll
+        notEmpty_.notify_one();
+
+        if(n <= 0)
+        {
+            return nullptr;
+        }
+        if(ev.data.fd == wakeFd_)
+        {
+            uint64_t cnt;
+            ssize_t r = ::read(wakeFd_, &cnt, sizeof(cnt));
+            (void)r;
+            return nullptr;
+        }
+        auto it = fdHandlers_.find(ev.data.fd);
+        if(it == fdHandlers_.end())
+        {
+            return nullptr;
+        }
+        // epoll_wait返回后、拿到锁之前modifyFd可能已经重新监听了这个fd，上一次的回调还没返回时丢弃这个事件，
+        // 回调返回后rearmFd重新监听，fd仍然就绪时内核会再次报告
+        if(it->second->running)
+        {
+            return nullptr;
+        }
+        it->second->running = true;
+        revents = ev.events;
+        return it->second;
+    }
+
+    // 回调执行完后重新监听fd，fd已经取消注册或者重新注册过则忽略
+    void rearmFd(const std::shared_ptr<FdHandler> &handler)
+    {
+        Lock lock(taskQueMtx_);
+        handler->running = false;
+        auto it = fdHandlers_.find(handler->fd);
+        if(it != fdHandlers_.end() && it->second == handler)
+        {
+            epoll_event ev{};
+            ev.events = handler->events | EPOLLONESHOT;
+            ev.data.fd = handler->fd;
+            ::epoll_ctl(reactorFd_, EPOLL_CTL_MOD, handler->fd, &ev);
+        }
+    }
 
-    // 线程池析构，有构造必须析构
-    ~ThreadPool()
+    // 工作线程正在执行的任务，执行完成后报告给准入策略、观察者和资源组的统计
+    struct TaskRun
     {
-        // 优雅退出
-        isPoolRunning_ = false;
+        TaskItem *item;
+        TaskGroup *group;
+        TaskObserver *observer; // 不需要报告时为nullptr
+        std::chrono::steady_clock::time_point startTime;
+        std::chrono::steady_clock::time_point endTime; // 报告时记录
+        bool reported;
+    };
 
-        // 等待线程池中所有线程返回，有两种状态，等待和执行
-        notEmpty_.notify_all();
-        std::unique_lock<std::mutex> lock(taskQueMtx_);
-        exitCond_.wait(lock, [&]() -> bool
-                    { return threads_.size() == 0; });
-    }
-    
-    // 开启线程池
-    void start(int initThreadSize = std::thread::hardware_concurrency())
+    // 报告当前工作线程正在执行的任务已经完成，每个任务只报告一次；当前线程没有正在执行的任务时什么都不做
+    // 提交的任务在结果交给promise之前调用，其他任务（例如reactor注册的回调）由工作线程在执行之后调用
+    static void reportTaskDone()
     {
-        // 设置线程池的启动状态
-        isPoolRunning_ = true;
+        TaskRun *run = currentWorker().run;
+        if(run == nullptr || run->reported)
+        {
+            return;
+        }
+        run->reported = true;
+        run->endTime = std::chrono::steady_clock::now();
+
+        TaskItem &item = *run->item;
+        if(item.policies != nullptr)
+        {
+            auto latency = run->endTime - item.enqueueTime;
+            for(auto &policy : *item.policies)
+            {
+                policy->onComplete(item.tag, latency);
+            }
+        }
+        if(run->observer != nullptr)
+        {
+            run->observer->onTaskDone(run->group->traceName_, item.tag, run->startTime - item.enqueueTime, run->endTime - run->startTime);
+        }
+        run->group->completed_++;
+    }
 
-        // 记录初始线程个数
-        initThreadSize_ = initThreadSize;
-        curThreadSize_ = initThreadSize;
+    // 工作线程的线程局部上下文，用来判断当前线程属于哪个线程池
+    struct WorkerContext
+    {
+        BasicThreadPool *pool = nullptr;
+        int threadId = -1;
+        int blockingDepth = 0; // 阻塞区域的嵌套深度
+        int slot = -1; // 工作线程的槽位
+        std::vector<void *> locals; // WorkerLocal在当前线程的对象，按WorkerLocal的slot索引，加速查找
+        TaskRun *run = nullptr; // 正在执行、还没有报告完成的任务
+    };
 
-        // 创建线程对象，保证公平性，先集中创建再启动
-        for (int i = 0; i < initThreadSize_; ++i)
+    // 在当前线程执行一组生命周期钩子，钩子列表先在锁下拷贝一份
+    void runWorkerHooks(const std::vector<std::pair<int, WorkerHook>> &hooks, int threadId)
+    {
+        std::vector<std::pair<int, WorkerHook>> copy;
         {
-            // 创建thread线程对象的时候，把线程函数给到thread对象
-            auto ptr = std::make_unique<Thread>(std::bind(&ThreadPool::threadFunc, this, std::placeholders::_1));
-            int threadId = ptr->getId();
-            threads_.emplace(threadId, std::move(ptr));
+            std::unique_lock<std::mutex> lock(hookMtx_);
+            copy = hooks;
         }
+        for(auto &hook : copy)
+        {
+            hook.second(threadId);
+        }
+    }
+
+    static WorkerContext &currentWorker()
+    {
+        static thread_local WorkerContext ctx;
+        return ctx;
+    }
 
-        // 启动所有线程
-        for (int i = 0; i < initThreadSize_; ++i)
+    // 当前工作线程进入阻塞：可运行的线程数少于initThreadSize_时，优先取消一个待退出的线程，否则创建补偿线程
+    void beginBlocking()
+    {
+        Thread *spawned = nullptr;
+        Lock lock(taskQueMtx_);
+        blockedThreadSize_++;
+        if(isPoolRunning_
+            && curThreadSize_ - retireSize_ - blockedThreadSize_ < (int)initThreadSize_
+            && curThreadSize_ < (int)threadSizeThreshHold_)
         {
-            threads_[i]->start();
-            idleThreadSize_++;
+            if(retireSize_ > 0)
+            {
+                retireSize_--;
+            }
+            else
+            {
+#ifdef THREADPOOL_DEBUG
+                std::cout << ">>>create compensating thread..." << std::endl;
+#endif
+                spawned = addThread();
+            }
+            compensateSize_++;
+        }
+        lock.unlock();
+        if(spawned != nullptr)
+        {
+            spawned->start();
         }
     }
-    
-    // 设置线程池的工作模式
-    void setMode(PoolMode mode)
+
+    // 当前工作线程离开阻塞：之前补偿的线程多余了，请求一个线程在空闲时退出
+    void endBlocking()
     {
-        // 不允许启动后再设置
-        if(checkRunninngState())
+        Lock lock(taskQueMtx_);
+        blockedThreadSize_--;
+        if(compensateSize_ > 0)
         {
-            return;
+            compensateSize_--;
+            retireSize_++;
+            notEmpty_.notify_all();
+            wakeReactor();
         }
-        poolMode_ = mode;
     }
 
-    // 设置task任务队列上限阈值
-    void setTaskQueMaxThreshHold(int threshhold)
+    // 创建并启动一个新的工作线程，调用方需要持有taskQueMtx_
+    // 创建系统线程比较慢，返回的线程由调用方释放taskQueMtx_之后再start；线程启动前不会退出，返回的指针一直有效
+    Thread *addThread()
     {
-        // 不允许启动后再设置
-        if(checkRunninngState())
+        auto ptr = std::make_unique<Thread>(std::bind(&BasicThreadPool::threadFunc, this, std::placeholders::_1));
+        Thread *thread = ptr.get();
+        threads_.emplace(thread->getId(), std::move(ptr));
+        // 修改相关变量
+        curThreadSize_++;
+        idleThreadSize_++;
+        return thread;
+    }
+
+    // 回收当前线程，调用方需要持有taskQueMtx_，并且已经在锁下决定当前线程退出
+    // 线程数量和槽位在锁下立即归还，其他线程的退出判断（cached模式的空闲回收等）马上就能看到；
+    // 然后在锁外执行onWorkerStop钩子，最后把线程对象从线程列表中删除，析构函数等到线程列表为空才返回
+    void exitThread(Lock &lock, int threadId)
+    {
+        curThreadSize_--;
+        idleThreadSize_--;
+
+        // 让出槽位，槽位中剩下的任务由其他线程窃取
+        WorkerContext &ctx = currentWorker();
+        slots_[ctx.slot]->owned = false;
+        if(!slots_[ctx.slot]->tasks.empty())
         {
-            return;
+            notEmpty_.notify_all();
         }
-        taskQueThreshHold_ = threshhold;
+
+        lock.unlock();
+        runWorkerHooks(stopHooks_, threadId);
+        ctx.pool = nullptr;
+        ctx.slot = -1;
+        ctx.locals.clear();
+        currentTaskTrace().worker = false;
+        lock.lock();
+
+        threads_.erase(threadId);
+
+#ifdef THREADPOOL_DEBUG
+        std::cout << "threadid:" << std::this_thread::get_id() << " exit" << std::endl;
+#endif
+        exitCond_.notify_all();
     }
 
-    // 设置线程池cached模式下线程阈值
-    void setThreadSizeThreshHold(int threshhold)
+    // 任务提交失败时返回的空返回值
+    template<typename RType>
+    static std::future<RType> emptyResult()
     {
-        // 不允许启动后再设置
-        if(checkRunninngState())
+        // 任务提交失败，直接返回空的函数对象产生的空返回值；也可以直接抛异常
+        auto task = std::make_shared<std::packaged_task<RType()>>([]() -> RType
+                                                                  { return RType(); });
+        // 注意一定要执行任务，否则get会出错
+        (*task)();
+        return task->get_future();
+    }
+
+    // 把打包好的任务转换为TaskStorage：可拷贝的存储（std::function）放到共享对象中，只能移动的存储（InplaceTask）直接构造
+    template<typename R, typename Call>
+    Task makeTask(std::promise<R> promise, Call call)
+    {
+        PromiseTask<R, Call> task{std::move(promise), std::move(call)};
+        if constexpr (std::is_copy_constructible<Task>::value)
         {
-            return;
+            auto shared = std::allocate_shared<PromiseTask<R, Call>>(alloc_, std::move(task));
+            return Task([shared]() { (*shared)(); });
         }
-        if(poolMode_ == PoolMode::MODE_CACHED)
+        else
         {
-            threadSizeThreshHold_ = threshhold;
+            return Task(std::move(task));
         }
     }
 
-    // 给线程池提交任务，使用可变参模板编程，使其可以接收任意任务函数和任意数量的参数
-    // pool.submitTask(sum1, 10, 20)
+    // 给指定资源组提交任务，wait为true时队列满最多等待1秒，status返回提交结果
     template<typename Func, typename... Args>
-    auto submitTask(Func&& func, Args&&... args) ->std::future<decltype(func(args...))>
+    auto submitTaskTo(TaskGroup *group, const char *tag, Affinity affinity, bool wait, SubmitStatus &status, Func&& func, Args&&... args) ->std::future<decltype(func(args...))>
     {
         // 打包任务，放入任务队列
         using RType = decltype(func(args...));
-        auto task = std::make_shared<std::packaged_task<RType()>>(std::bind(std::forward<Func>(func), std::forward<Args>(args)...));
-        std::future<RType> result = task->get_future();
+
+        // 在锁外依次经过准入策略，任何一个拒绝都要让之前接受的策略归还名额
+        std::shared_ptr<const AdmissionList> policies = std::atomic_load(&policies_);
+        if(policies != nullptr)
+        {
+            for(size_t i = 0; i < policies->size(); ++i)
+            {
+                if(!(*policies)[i]->admit(tag))
+                {
+                    for(size_t j = 0; j < i; ++j)
+                    {
+                        (*policies)[j]->onCancel(tag);
+                    }
+                    if(wait)
+                    {
+                        std::cerr << "task rejected by admission policy, submit task fail." << std::endl;
+                    }
+                    group->rejected_++;
+                    status = SubmitStatus::REJECTED;
+                    return emptyResult<RType>();
+                }
+            }
+        }
+
+        // 任务的共享状态和std::function需要的共享对象都通过allocator分配
+        std::promise<RType> promise(std::allocator_arg, alloc_);
+        std::future<RType> result = promise.get_future();
+        Task task = makeTask(std::move(promise), std::bind(std::forward<Func>(func), std::forward<Args>(args)...));
 
         // 获取锁
-        std::unique_lock<std::mutex> lock(taskQueMtx_);
+        Lock lock(taskQueMtx_);
+
+        // 等待资源组的任务队列有空余，非阻塞提交时不等待
+        auto notFull = [&]() -> bool
+        { return group->removed_ || group->taskQue_.size() + group->affineQueued_ < group->taskQueThreshHold_; };
+        bool full = wait ? !notFull_.wait_for(lock, std::chrono::seconds(1), notFull) : !notFull();
+        if(group->removed_)
+        {
+            std::cerr << "task group " << group->name_ << " has been removed, submit task fail." << std::endl;
+            group->rejected_++;
+            lock.unlock();
+            if(policies != nullptr)
+            {
+                for(auto &policy : *policies)
+                {
+                    policy->onCancel(tag);
+                }
+            }
+            status = SubmitStatus::REJECTED;
+            return emptyResult<RType>();
+        }
+        if(full)
+        {
+            if(wait)
+            {
+                std::cerr << "task queue is full, submit task fail." << std::endl;
+            }
+            group->rejected_++;
+            lock.unlock();
+            if(policies != nullptr)
+            {
+                for(auto &policy : *policies)
+                {
+                    policy->onCancel(tag);
+                }
+            }
+            status = SubmitStatus::QUEUE_FULL;
+            return emptyResult<RType>();
+        }
 
-        // 等待任务队列有空余
-        if(!notFull_.wait_for(lock, std::chrono::seconds(1), [&]() -> bool
-                        { return taskQue_.size() < taskQueThreshHold_; }))
+        // 资源组从空闲变为活跃时，虚拟时间追上全局进度，避免空闲期间积攒的份额一次性抢占所有线程
+        if(group->taskQue_.empty() && group->affineQueued_ == 0 && group->running_ == 0 && group->pass_ < globalPass_)
         {
-            std::cerr << "task queue is full, submit task fail." << std::endl;
-            // 任务提交失败，直接返回空的函数对象产生的空返回值；也可以直接抛异常
-            auto task = std::make_shared<std::packaged_task<RType()>>([]() -> RType
-                                                                      { return RType(); });
-            // 注意一定要执行任务，否则get会出错
-            (*task)();
-            return task->get_future();
+            group->pass_ = globalPass_;
         }
 
-        // 如果有空余，把任务放入任务队列中
-        taskQue_.emplace([task]() { (*task)(); });
+        // 如果有空余，把任务放入任务队列中，有准入策略或者观察者时记录入队时间用来测量排队时间和延迟
+        TaskItem item{std::move(task), tag, policies, {}};
+        if(policies != nullptr || observing_.load(std::memory_order_relaxed))
+        {
+            item.enqueueTime = std::chrono::steady_clock::now();
+        }
+        int slot = resolveSlot(affinity);
+        if(slot >= 0)
+        {
+            slots_[slot]->tasks.emplace(SlotItem{group, std::move(item)});
+            group->affineQueued_++;
+        }
+        else
+        {
+            group->taskQue_.emplace(std::move(item));
+        }
+        group->submitted_++;
         taskSize_++;
 
         // 在notEmpty_上通知
         notEmpty_.notify_all();
 
+        // 只剩leader线程空闲时，或者任务放进了leader自己的槽位（其他线程不会取），把它从epoll_wait中唤醒来执行任务
+        if(idleThreadSize_ <= 1 || (slot >= 0 && slot == reactorSlot_))
+        {
+            wakeReactor();
+        }
+
         // cached模式：需要根据任务数量和空闲县茨城的数量，判断是否需要创建新的线程
         if(poolMode_ == PoolMode::MODE_CACHED 
             && taskSize_ > idleThreadSize_ 
@@ -197,74 +1898,226 @@ public:
         {
             std::cout << ">>>create new thread..." << std::endl;
 
-            // 创建新线程
-            auto ptr = std::make_unique<Thread>(std::bind(&ThreadPool::threadFunc, this, std::placeholders::_1));
-            int threadId = ptr->getId();
-            threads_.emplace(threadId, std::move(ptr));
-            // 启动线程
-            threads_[threadId]->start();
-            // 修改相关变量
-            curThreadSize_++;
-            idleThreadSize_++;
+            // 创建新线程，在锁外启动
+            Thread *spawned = addThread();
+            lock.unlock();
+            spawned->start();
         }
 
         // 返回任务的Result对象
+        status = SubmitStatus::OK;
         return result;
     }
 
-    ThreadPool(const ThreadPool &) = delete;
-    ThreadPool &operator=(const ThreadPool &) = delete;
-private:
+    // 把亲和性提示解析为槽位，没有提示或者还没有工作线程时返回-1，调用方需要持有taskQueMtx_
+    // 按键选择时跳过没有线程占用的槽位，线程数减少后相同的键仍然稳定地落在同一个线程上
+    int resolveSlot(Affinity affinity) const
+    {
+        if(affinity.kind == Affinity::NONE || slots_.empty())
+        {
+            return -1;
+        }
+        size_t count = slots_.size();
+        if(affinity.kind == Affinity::WORKER)
+        {
+            return (int)(affinity.value % count);
+        }
+        // 打散用户哈希的低位，std::hash<int>等是恒等映射
+        size_t slot = (affinity.value * 0x9E3779B97F4A7C15ull >> 32) % count;
+        for(size_t i = 0; i < count; ++i)
+        {
+            if(slots_[(slot + i) % count]->owned)
+            {
+                return (int)((slot + i) % count);
+            }
+        }
+        return (int)slot;
+    }
+
+    // 新的工作线程占用编号最小的空闲槽位，没有则新建一个，调用方需要持有taskQueMtx_
+    int acquireSlot()
+    {
+        for(size_t i = 0; i < slots_.size(); ++i)
+        {
+            if(!slots_[i]->owned)
+            {
+                slots_[i]->owned = true;
+                slots_[i]->busy = false;
+                return (int)i;
+            }
+        }
+        slots_.emplace_back(std::make_unique<WorkerSlot>(alloc_));
+        slots_.back()->owned = true;
+        return (int)slots_.size() - 1;
+    }
+
+    // 槽位队列的队头任务是否可以执行（资源组没有达到并发上限）
+    static bool slotRunnable(WorkerSlot &slot)
+    {
+        if(slot.tasks.empty())
+        {
+            return false;
+        }
+        TaskGroup *group = slot.tasks.front().group;
+        return group->maxConcurrency_ == 0 || group->running_ < group->maxConcurrency_;
+    }
+
+    // 选择工作线程的下一个任务，返回任务所属的资源组，没有可执行的任务时返回nullptr；slot返回任务所在的槽位，-1表示资源组的共享队列
+    // 优先执行自己槽位中的任务，其次按步进调度选择资源组，最后从没有线程、线程正忙或者积压超过阈值的槽位窃取
+    // 线程正忙时不窃取的话，槽位中的任务要等它执行完手头的任务，在阻塞区域中或者等待这些任务自身时会一直饿死
+    // 调用方需要持有taskQueMtx_
+    TaskGroup *pickWork(int mySlot, int &slot)
+    {
+        slot = -1;
+        if(mySlot >= 0 && slotRunnable(*slots_[mySlot]))
+        {
+            slot = mySlot;
+            return slots_[mySlot]->tasks.front().group;
+        }
+        TaskGroup *group = pickGroup();
+        if(group != nullptr)
+        {
+            return group;
+        }
+        int victim = -1;
+        size_t most = 0;
+        for(size_t i = 0; i < slots_.size(); ++i)
+        {
+            WorkerSlot &slot = *slots_[i];
+            if((int)i == mySlot || !slotRunnable(slot))
+            {
+                continue;
+            }
+            size_t backlog = slot.owned ? slot.tasks.size() : SIZE_MAX;
+            bool stealable = !slot.owned || slot.busy || backlog > Config::AFFINITY_STEAL_THRESHHOLD;
+            if(stealable && (victim < 0 || backlog > most))
+            {
+                victim = (int)i;
+                most = backlog;
+            }
+        }
+        if(victim < 0)
+        {
+            return nullptr;
+        }
+        slot = victim;
+        return slots_[victim]->tasks.front().group;
+    }
+
+    // 把已经移除、没有排队和正在执行的任务的资源组从调度列表中删除，调用方需要持有taskQueMtx_
+    void sweepGroups()
+    {
+        groups_.erase(std::remove_if(groups_.begin(), groups_.end(), [](const std::shared_ptr<TaskGroup> &group) -> bool
+        { return group->removed_ && group->taskQue_.empty() && group->affineQueued_ == 0 && group->running_ == 0; }),
+                      groups_.end());
+    }
+
+    // 按步进调度选择下一个要执行的资源组：在可调度的资源组中选择虚拟时间最小的，没有则返回nullptr
+    // 调用方需要持有taskQueMtx_
+    TaskGroup *pickGroup() const
+    {
+        TaskGroup *picked = nullptr;
+        for(const auto &group : groups_)
+        {
+            if(group->runnable() && (picked == nullptr || group->pass_ < picked->pass_))
+            {
+                picked = group.get();
+            }
+        }
+        return picked;
+    }
+
+    // 更新当前线程的任务记录，信号屏障保证采样信号处理函数看到的是完整的记录
+    static void setTrace(TaskTrace &trace, const char *group, const char *tag, bool running)
+    {
+        trace.running = false;
+        std::atomic_signal_fence(std::memory_order_seq_cst);
+        trace.group = group;
+        trace.tag = tag;
+        std::atomic_signal_fence(std::memory_order_seq_cst);
+        trace.running = running;
+    }
+
     // 定义线程函数
     void threadFunc(int threadId)
     {
         auto lastTime = std::chrono::high_resolution_clock().now();
 
+        WorkerContext &ctx = currentWorker();
+        ctx.pool = this;
+        ctx.threadId = threadId;
+        TaskTrace &trace = currentTaskTrace();
+        trace.worker = true;
+        {
+            Lock lock(taskQueMtx_);
+            ctx.slot = acquireSlot();
+        }
+        runWorkerHooks(startHooks_, threadId);
+
         //循环等待
         for (;;)
         {
-            Task task;
+            TaskItem item;
+            TaskGroup *group = nullptr;
+            std::shared_ptr<TaskGroup> keepAlive; // 资源组可能在任务执行期间被移除和删除，需要持有它；默认资源组与线程池同生命周期，不需要持有
+            uint64_t estimate = 0; // 调度时预扣的虚拟时间
+            int slot = -1; // 任务来自哪个工作线程槽位，-1表示资源组的共享队列
+            std::shared_ptr<FdHandler> handler; // leader线程拿到的就绪fd
+            uint32_t revents = 0;
             {
                 // 先获取锁
-                std::unique_lock<std::mutex> lock(taskQueMtx_);
+                Lock lock(taskQueMtx_);
+                slots_[ctx.slot]->busy = false; // 回来取任务，槽位中的任务留给自己
 
+#ifdef THREADPOOL_DEBUG
                 std::cout << "tid:" << std::this_thread::get_id() << "尝试获取任务" << std::endl;
+#endif
+
+                // 阻塞区域结束后多出来的补偿线程，执行完手头的任务后在这里退出
+                if(retireSize_ > 0)
+                {
+                    retireSize_--;
+                    exitThread(lock, threadId);
+                    return;
+                }
 
                 // cached模式：有可能已经创建了很多线程，但是空闲时间超过60s，应该把多余的线程回收（超过initThreadSize_的数量要进行回收）
-                while(taskQue_.size() == 0)
+                while((group = pickWork(ctx.slot, slot)) == nullptr)
                 {
                     // 线程池要结束，回收线程资源
                     if(!isPoolRunning_)
                     {
-                        threads_.erase(threadId);
-                        curThreadSize_--;
-                        idleThreadSize_--;
-
-                        std::cout << "threadid:" << std::this_thread::get_id() << " exit" << std::endl;
-                        exitCond_.notify_all();
+                        exitThread(lock, threadId);
                         return;
                     }
 
+                    // 没有leader时当前线程成为leader等待epoll，拿到就绪事件后直接执行，不经过任务队列
+                    if(reactorFd_ >= 0 && !reactorPolling_)
+                    {
+                        int timeoutMs = poolMode_ == PoolMode::MODE_CACHED ? 1000 : -1;
+                        handler = pollReactor(lock, ctx.slot, timeoutMs, revents);
+                        if(handler != nullptr)
+                        {
+                            break;
+                        }
+                        continue;
+                    }
+
                     if(poolMode_ == PoolMode::MODE_CACHED)
                     {
                         // 不能一直等待，需要每一秒检查一次
                         if(!notEmpty_.wait_for(lock, std::chrono::seconds(1), [&]() -> bool
-                            { return taskQue_.size() > 0; }))
+                            { return (group = pickWork(ctx.slot, slot)) != nullptr || retireSize_ > 0; }))
                         {
                             auto now = std::chrono::high_resolution_clock().now();
                             auto dur = std::chrono::duration_cast<std::chrono::seconds>(now - lastTime);
-                            if(dur.count() >= THREAD_MAX_IDLE_TIME
+                            if(dur.count() >= Config::THREAD_IDLE_TIME
                                 && curThreadSize_ > initThreadSize_)
                             {
                                 // 开始回收当前线程
                                 // 记录线程数量变化
                                 // 把线程对象从线程列表中删除，难点：怎么确定threadFunc对应的thread对象
-                                threads_.erase(threadId);
-                                curThreadSize_--;
-                                idleThreadSize_--;
-
-                                std::cout << "threadid:" << std::this_thread::get_id() << " exit" << std::endl;
-                                exitCond_.notify_all();
+                                exitThread(lock, threadId);
                                 return;
                             }
                         }
@@ -274,31 +2127,121 @@ private:
                         // 等待notEmpty条件
                         notEmpty_.wait(lock);
                     }
+
+                    // 空闲线程被唤醒来处理退出请求
+                    if(retireSize_ > 0)
+                    {
+                        retireSize_--;
+                        exitThread(lock, threadId);
+                        return;
+                    }
                 }
 
                 idleThreadSize_--;
+                slots_[ctx.slot]->busy = true; // 执行任务期间槽位中的任务可以被空闲线程窃取
+
+                if(group != nullptr)
+                {
+#ifdef THREADPOOL_DEBUG
+                    std::cout << "tid:" << std::this_thread::get_id() << "获取任务成功" << std::endl;
+#endif
+
+                    // 从选中的资源组或者槽位取一个任务出来，并推进资源组的虚拟时间
+                    if(slot >= 0)
+                    {
+                        item = std::move(slots_[slot]->tasks.front().item);
+                        slots_[slot]->tasks.pop();
+                        group->affineQueued_--;
+                    }
+                    else
+                    {
+                        item = std::move(group->taskQue_.front());
+                        group->taskQue_.pop();
+                    }
+                    group->running_++;
+                    globalPass_ = group->pass_;
+                    estimate = group->avgCharge_.load(std::memory_order_relaxed);
+                    group->pass_ += estimate;
+                    if(group != defaultGroup_.get())
+                    {
+                        keepAlive = group->shared_from_this();
+                    }
+                    taskSize_--;
 
-                std::cout << "tid:" << std::this_thread::get_id() << "获取任务成功" << std::endl;
+                    // 如果依然有任务，通知其他线程执行任务
+                    if(taskSize_ > 0)
+                    {
+                        notEmpty_.notify_all();
+                    }
 
-                // 取一个任务出来
-                task = taskQue_.front();
-                taskQue_.pop();
-                taskSize_--;
+                    // 在notFull上通知
+                    notFull_.notify_all();
+                }
+            } // 应该释放锁，保证不影响其他线程执行
 
-                // 如果依然有任务，通知其他线程执行任务
-                if(taskQue_.size() > 0)
+            if(handler != nullptr)
+            {
+                // 执行就绪fd的回调，然后重新监听
+                setTrace(trace, "reactor", nullptr, true);
+                handler->callback(revents);
+                setTrace(trace, nullptr, nullptr, false);
+                rearmFd(handler);
+            }
+            else
+            {
+                // 入队时记录了时间才有排队时间可以报告，开启观察之前入队的任务不报告
+                std::shared_ptr<TaskObserver> observer;
+                if(observing_.load(std::memory_order_relaxed) && item.enqueueTime != std::chrono::steady_clock::time_point())
                 {
-                    notEmpty_.notify_all();
+                    observer = std::atomic_load(&observer_);
                 }
+                // 执行时间同时用于资源组的虚拟时间，每个任务都需要计时
+                auto startTime = std::chrono::steady_clock::now();
 
-                // 在notFull上通知
-                notFull_.notify_all();
-            } // 应该释放锁，保证不影响其他线程执行
+                if(item.policies != nullptr)
+                {
+                    auto sojourn = startTime - item.enqueueTime;
+                    for(auto &policy : *item.policies)
+                    {
+                        policy->onStart(item.tag, sojourn);
+                    }
+                }
+
+                // 当前线程负责执行任务
+                TaskRun run{&item, group, observer.get(), startTime, {}, false};
+                ctx.run = &run;
+                setTrace(trace, group->traceName_, item.tag, true);
+                if(item.task != nullptr){
+                    // 执行任务，把结果给Result
+                    item.task();
+                }
+                setTrace(trace, nullptr, nullptr, false);
+                reportTaskDone(); // 提交的任务在把结果交给promise之前已经报告过
+                ctx.run = nullptr;
+                auto endTime = run.endTime;
+
+                // 按实际执行时间补上调度时预扣的虚拟时间（无符号回绕相当于减去多扣的部分），并更新平均值
+                uint64_t runNs = std::chrono::duration_cast<std::chrono::nanoseconds>(endTime - startTime).count();
+                uint64_t charge = runNs * GROUP_STRIDE / group->weight_;
+                group->pass_.fetch_add(charge - estimate, std::memory_order_relaxed);
+                uint64_t avg = group->avgCharge_.load(std::memory_order_relaxed);
+                group->avgCharge_.store(avg - avg / 8 + charge / 8, std::memory_order_relaxed);
 
-            // 当前线程负责执行任务
-            if(task != nullptr){
-                // 执行任务，把结果给Result
-                task();
+                // 先减少running_再检查removed_：removeGroup先设置removed_再检查running_，两边至少有一边会看到对方，
+                // 任务执行期间被移除的资源组由这里或者removeGroup从调度列表中删除
+                bool capped = group->maxConcurrency_ != 0;
+                group->running_--;
+                bool removed = group->removed_;
+                if(capped || removed)
+                {
+                    // 有并发上限的资源组释放了一个名额，排队的任务可能因此变为可调度，需要在锁下通知避免丢失唤醒
+                    Lock lock(taskQueMtx_);
+                    if(removed)
+                    {
+                        sweepGroups();
+                    }
+                    notEmpty_.notify_all();
+                }
             }
             idleThreadSize_++;
             lastTime = std::chrono::high_resolution_clock().now(); // 更新线程执行完任务的时间
@@ -319,19 +2262,168 @@ private:
     std::atomic_int curThreadSize_; //当前线程数量，防止vector线程不安全，size会出错
     size_t threadSizeThreshHold_; // 线程数量上限阈值
     std::atomic_int idleThreadSize_; //记录空闲线程的数量
+    std::atomic_int blockedThreadSize_; // 处于阻塞区域中的线程数量
+    int compensateSize_; // 因阻塞区域而额外创建、尚未归还的补偿线程数量，由taskQueMtx_保护
+    int retireSize_; // 等待退出的多余线程数量，由taskQueMtx_保护
 
-    using Task = std::function<void()>; // 无法确定传入的函数类型，需要中间层解决，此处直接定义为void即可
-    std::queue<Task> taskQue_; // 任务队列，此时Task完全属于线程池内部，无需智能指针延长其生命周期
-    std::atomic_uint taskSize_; // 任务数量，被用户和线程池同时读写，需要线程安全
-    size_t taskQueThreshHold_; // 任务数量上限阈值
+    std::vector<std::unique_ptr<WorkerSlot>> slots_; // 工作线程槽位，只增加不删除，由taskQueMtx_保护
+    std::vector<std::shared_ptr<TaskGroup>> groups_; // 所有资源组，每个资源组拥有自己的任务队列，Task完全属于线程池内部
+    std::shared_ptr<TaskGroup> defaultGroup_; // 默认资源组，线程池自身的submitTask提交到这里
+    std::atomic_uint taskSize_; // 所有资源组排队的任务总数，被用户和线程池同时读写，需要线程安全
+    uint64_t globalPass_; // 最近一次调度的虚拟时间，资源组重新活跃时以此为起点
 
-    std::mutex taskQueMtx_; // 保证任务队列线程安全
-    std::condition_variable notFull_; // 表示队列不满
-    std::condition_variable notEmpty_; // 表示队列不空
-    std::condition_variable exitCond_; //等待线程资源全部回收
+    Mutex taskQueMtx_; // 保证任务队列线程安全
+    CondVar notFull_; // 表示队列不满
+    CondVar notEmpty_; // 表示队列不空
+    CondVar exitCond_; //等待线程资源全部回收
 
     PoolMode poolMode_; // 当前线程池的工作模式
     std::atomic_bool isPoolRunning_; // 表示当前线程池的启动状态
+
+    int reactorFd_; // 反应器的epoll fd，-1表示没有开启
+    int wakeFd_; // 用来唤醒leader线程的eventfd
+    bool reactorPolling_; // 是否有leader线程正在epoll_wait，由taskQueMtx_保护
+    int reactorSlot_; // 正在epoll_wait的leader线程的槽位，-1表示没有，由taskQueMtx_保护
+    std::unordered_map<int, std::shared_ptr<FdHandler>> fdHandlers_; // 注册的fd回调，由taskQueMtx_保护
+
+    std::mutex hookMtx_; // 保护生命周期钩子列表
+    std::vector<std::pair<int, WorkerHook>> startHooks_; // 工作线程启动钩子
+    std::vector<std::pair<int, WorkerHook>> stopHooks_; // 工作线程退出钩子
+    int hookId_; // 最近分配的钩子id
+    std::atomic_int localSlots_; // 已分配的WorkerLocal slot数量，slot不复用
+
+    MemoCache memo_; // submitMemoized的结果缓存
+
+    std::shared_ptr<const AdmissionList> policies_; // 准入策略列表，写时复制，提交时原子读取一份快照
+    std::shared_ptr<TaskObserver> observer_; // 任务观察者，原子读写
+    std::atomic_bool observing_; // 是否设置了观察者，没有观察者时不读取observer_，也不记录时间
+
+    Allocator alloc_; // 任务队列和任务共享状态使用的分配器
+};
+
+/*
+example:
+ThreadPool pool;
+pool.start(4);
+WorkerLocal<Histogram> hist(pool);
+
+pool.submitTask([&]() { hist->add(latency); }); // 每个工作线程第一次访问时构造自己的Histogram
+
+Histogram total;
+hist.forEach([&](int threadId, Histogram &h) { total.merge(h); });
+*/
+// 工作线程局部对象：每个工作线程第一次访问时惰性构造一份，工作线程退出时销毁
+// 可以从线程池外遍历所有工作线程的对象做归约，遍历时需要保证没有任务在修改这些对象；WorkerLocal不能比线程池活得久
+template<typename T, typename Pool>
+class WorkerLocal
+{
+public:
+    using Factory = std::function<std::unique_ptr<T>()>;
+
+    explicit WorkerLocal(Pool &pool, Factory factory = []() { return std::make_unique<T>(); })
+        : pool_(pool)
+        , state_(std::make_shared<State>())
+        , slot_(pool.localSlots_++)
+    {
+        state_->factory = std::move(factory);
+        // 工作线程退出时销毁它的对象；退出钩子按注册顺序在退出的线程上执行，之前注册的钩子仍然可以访问这个对象
+        // 同时清掉线程上下文中缓存的指针，之后注册的钩子再访问时会重新构造，不会访问已经销毁的对象
+        std::shared_ptr<State> state = state_;
+        size_t slot = slot_;
+        hookId_ = pool_.onWorkerStop([state, slot](int threadId)
+        {
+            typename Pool::WorkerContext &ctx = Pool::currentWorker();
+            if(ctx.locals.size() > slot)
+            {
+                ctx.locals[slot] = nullptr;
+            }
+            std::unique_ptr<T> value;
+            std::unique_lock<std::mutex> lock(state->mtx);
+            auto it = state->values.find(threadId);
+            if(it != state->values.end())
+            {
+                value = std::move(it->second);
+                state->values.erase(it);
+            }
+        });
+    }
+
+    ~WorkerLocal()
+    {
+        pool_.removeWorkerHook(hookId_);
+    }
+
+    WorkerLocal(const WorkerLocal &) = delete;
+    WorkerLocal &operator=(const WorkerLocal &) = delete;
+
+    // 获取当前工作线程的对象，第一次访问时构造；不是本线程池的工作线程调用会抛出异常
+    T &get()
+    {
+        typename Pool::WorkerContext &ctx = Pool::currentWorker();
+        if(ctx.pool != &pool_)
+        {
+            throw std::runtime_error("WorkerLocal accessed outside of its pool's worker threads");
+        }
+        if(ctx.locals.size() > slot_ && ctx.locals[slot_] != nullptr)
+        {
+            return *static_cast<T *>(ctx.locals[slot_]);
+        }
+
+        std::unique_ptr<T> value = state_->factory();
+        T *ptr = value.get();
+        {
+            std::unique_lock<std::mutex> lock(state_->mtx);
+            state_->values[ctx.threadId] = std::move(value);
+        }
+        if(ctx.locals.size() <= slot_)
+        {
+            ctx.locals.resize(slot_ + 1, nullptr);
+        }
+        ctx.locals[slot_] = ptr;
+        return *ptr;
+    }
+
+    T &operator*()
+    {
+        return get();
+    }
+
+    T *operator->()
+    {
+        return &get();
+    }
+
+    // 遍历所有已经构造的对象，func(threadId, T&)
+    template<typename Func>
+    void forEach(Func&& func)
+    {
+        std::unique_lock<std::mutex> lock(state_->mtx);
+        for(auto &value : state_->values)
+        {
+            func(value.first, *value.second);
+        }
+    }
+
+    // 已经构造的对象数量
+    size_t size() const
+    {
+        std::unique_lock<std::mutex> lock(state_->mtx);
+        return state_->values.size();
+    }
+
+private:
+    // 退出钩子可能比WorkerLocal活得久，对象表用shared_ptr共享
+    struct State
+    {
+        std::mutex mtx;
+        Factory factory;
+        std::unordered_map<int, std::unique_ptr<T>> values; // 工作线程id -> 对象
+    };
+
+    Pool &pool_;
+    std::shared_ptr<State> state_;
+    size_t slot_; // 在工作线程上下文locals中的下标
+    int hookId_;
 };
 
 #endif
\ No newline at end of file